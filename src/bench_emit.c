@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+/* Microbenchmark: command words per second written with the ETNA_EMIT*
+ * macros (one etna_reserve per command) and with the emit cursor (one
+ * etna_begin_emit per batch). Commands go to a fragment, so no GPU is needed.
+ */
+#include <etna.h>
+#include <etna_util.h>
+#include <state.xml.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Commands per batch, and batches per round */
+#define BENCH_BATCH (64)
+#define BENCH_BATCHES (256)
+#define BENCH_ROUNDS (200)
+/* LOAD_STATE of one state and a draw */
+#define BENCH_CMD_WORDS (6)
+
+static uint32_t checksum(const struct etna_ctx *frag)
+{
+    uint32_t sum = 0;
+    for(uint32_t x=0; x<frag->offset; ++x)
+        sum += frag->buf[x];
+    return sum;
+}
+
+static int emit_macros(struct etna_ctx *frag)
+{
+    for(int b=0; b<BENCH_BATCHES; ++b)
+    {
+        for(int x=0; x<BENCH_BATCH; ++x)
+        {
+            if(etna_reserve(frag, BENCH_CMD_WORDS) != ETNA_OK)
+                return ETNA_OUT_OF_MEMORY;
+            ETNA_EMIT_LOAD_STATE(frag, VIVS_FE_VERTEX_STREAM_BASE_ADDR>>2, 1, 0);
+            ETNA_EMIT(frag, x * 16);
+            ETNA_EMIT_DRAW_PRIMITIVES(frag, PRIMITIVE_TYPE_TRIANGLES, x * 3, 1);
+        }
+    }
+    return ETNA_OK;
+}
+
+static int emit_cursor(struct etna_ctx *frag)
+{
+    for(int b=0; b<BENCH_BATCHES; ++b)
+    {
+        uint32_t *cur = etna_begin_emit(frag, BENCH_BATCH * BENCH_CMD_WORDS);
+        if(cur == NULL)
+            return ETNA_OUT_OF_MEMORY;
+        for(int x=0; x<BENCH_BATCH; ++x)
+        {
+            ETNA_CURSOR_LOAD_STATE(cur, VIVS_FE_VERTEX_STREAM_BASE_ADDR>>2, 1, 0);
+            ETNA_CURSOR_EMIT(cur, x * 16);
+            ETNA_CURSOR_DRAW_PRIMITIVES(cur, PRIMITIVE_TYPE_TRIANGLES, x * 3, 1);
+        }
+        etna_end_emit(frag, cur);
+    }
+    return ETNA_OK;
+}
+
+static int run(const char *name, struct etna_ctx *frag, int (*emit)(struct etna_ctx *frag))
+{
+    uint64_t words = 0;
+    uint64_t elapsed = 0;
+    uint32_t sum = 0;
+    for(int r=0; r<BENCH_ROUNDS; ++r)
+    {
+        etna_fragment_reset(frag);
+        uint64_t start = etna_time_ns();
+        if(emit(frag) != ETNA_OK)
+        {
+            fprintf(stderr, "%s: out of memory\n", name);
+            return 1;
+        }
+        elapsed += etna_time_ns() - start;
+        words += frag->offset;
+        sum += checksum(frag);
+    }
+    printf("%-8s %12.0f words/s (%llu words in %.3f ms, checksum %08x)\n", name,
+           words * 1e9 / (elapsed ? elapsed : 1), (unsigned long long)words, elapsed / 1e6, sum);
+    return 0;
+}
+
+int main(void)
+{
+    /* A fragment only takes its connection and draw combining setting from
+     * the parent; the commands never reach the GPU */
+    static struct etna_ctx parent;
+    struct etna_ctx *frag = NULL;
+    int rv;
+    if((rv = etna_fragment_create(&parent, &frag)) != ETNA_OK)
+    {
+        fprintf(stderr, "Unable to create fragment: %i\n", rv);
+        return 1;
+    }
+    /* Warm up: grow the fragment to its final size */
+    emit_macros(frag);
+    rv = run("macros", frag, emit_macros) || run("cursor", frag, emit_cursor);
+    etna_fragment_free(frag);
+    return rv;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+/* Check that a fenced etna_flush whose fence signal overflows the kernel
+ * command queue doesn't deadlock on the fence mutex, which it holds while
+ * the queue is flushed. Needs a GPU; skipped (exit status 77) if the driver
+ * can't be opened.
+ */
+#include <etna.h>
+#include <etna_queue.h>
+#include <viv.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Events queued before the fenced flush: a multiple of the queue capacity
+ * (64), so that the queue is full when the fence signal is added */
+#define CHECK_EVENTS (128)
+/* Seconds before SIGALRM ends a deadlocked check */
+#define CHECK_TIMEOUT (10)
+
+static int check_fenced_flush(struct viv_conn *conn, struct etna_ctx *ctx, const char *name)
+{
+    uint32_t fence = 0;
+    int sig_id;
+    int rv;
+    if((rv = viv_user_signal_create(conn, 0, &sig_id)) != VIV_STATUS_OK)
+    {
+        fprintf(stderr, "%s: unable to create signal: %i\n", name, rv);
+        return 1;
+    }
+    for(int x=0; x<CHECK_EVENTS; ++x)
+    {
+        if((rv = etna_queue_signal(ctx->queue, sig_id, VIV_WHERE_COMMAND)) != ETNA_OK)
+        {
+            fprintf(stderr, "%s: etna_queue_signal failed: %i\n", name, rv);
+            return 1;
+        }
+    }
+    if((rv = etna_flush(ctx, &fence)) != ETNA_OK ||
+       (rv = viv_fence_finish(conn, fence, VIV_WAIT_INDEFINITE)) != VIV_STATUS_OK)
+    {
+        fprintf(stderr, "%s: fenced flush failed: %i\n", name, rv);
+        return 1;
+    }
+    viv_user_signal_destroy(conn, sig_id);
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+int main(void)
+{
+    struct viv_conn *conn = NULL;
+    struct etna_ctx *ctx = NULL;
+    int rv;
+
+    if(viv_open(VIV_HW_3D, &conn) != 0)
+    {
+        fprintf(stderr, "Unable to open GPU driver, skipping\n");
+        return 77;
+    }
+    if((rv = etna_create(conn, &ctx)) != ETNA_OK)
+    {
+        fprintf(stderr, "Unable to create context: %i\n", rv);
+        return 1;
+    }
+    alarm(CHECK_TIMEOUT);
+    if(check_fenced_flush(conn, ctx, "synchronous"))
+        return 1;
+    /* Not supported on all kernels */
+    if(etna_set_async(ctx, true) == ETNA_OK)
+    {
+        struct etna_ctx *other = NULL;
+        if(check_fenced_flush(conn, ctx, "asynchronous"))
+            return 1;
+        /* A synchronous context on a connection with a submission thread
+         * drains it under the fence mutex */
+        if((rv = etna_create(conn, &other)) != ETNA_OK)
+        {
+            fprintf(stderr, "Unable to create second context: %i\n", rv);
+            return 1;
+        }
+        if(check_fenced_flush(conn, other, "shared connection"))
+            return 1;
+        etna_free(other);
+        etna_set_async(ctx, false);
+    }
+    alarm(0);
+    etna_free(ctx);
+    viv_close(conn);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+/* Check that etna_reserve after a successful etna_try_flush does not wait
+ * for a command buffer signal that the try already consumed.
+ * Needs a GPU; skipped (exit status 77) if the driver can't be opened.
+ */
+#include <etna.h>
+#include <viv.h>
+#include <cmdstream.xml.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHECK_ITERATIONS (256)
+/* Seconds before SIGALRM ends a blocked check */
+#define CHECK_TIMEOUT (10)
+
+int main(void)
+{
+    struct viv_conn *conn = NULL;
+    struct etna_ctx *ctx = NULL;
+    struct etna_ctx_config config = {
+        .num_buffers = 2,
+        .buffer_size = MIN_COMMAND_BUFFER_SIZE,
+        .max_buffers = 0,
+        .grow_threshold = 0
+    };
+    /* Give up on the buffer after every second commit, so that etna_try_flush
+     * has to acquire the next one */
+    struct etna_flush_policy policy = {
+        .max_unsignaled_flushes = 1,
+        .max_wasted_bytes = MIN_COMMAND_BUFFER_SIZE
+    };
+    int rv;
+
+    if(viv_open(VIV_HW_3D, &conn) != 0)
+    {
+        fprintf(stderr, "Unable to open GPU driver, skipping\n");
+        return 77;
+    }
+    if((rv = etna_create_config(conn, &config, &ctx)) != ETNA_OK ||
+       (rv = etna_set_flush_policy(ctx, &policy)) != ETNA_OK)
+    {
+        fprintf(stderr, "Unable to create context: %i\n", rv);
+        return 1;
+    }
+    alarm(CHECK_TIMEOUT);
+    for(int x=0; x<CHECK_ITERATIONS; ++x)
+    {
+        if((rv = etna_reserve(ctx, 2)) != ETNA_OK)
+        {
+            fprintf(stderr, "etna_reserve failed: %i\n", rv);
+            return 1;
+        }
+        ETNA_EMIT(ctx, VIV_FE_NOP_HEADER_OP_NOP);
+        ETNA_EMIT(ctx, 0);
+        while((rv = etna_try_flush(ctx, NULL)) == ETNA_WOULD_BLOCK)
+        {
+            if((rv = etna_finish(ctx)) != ETNA_OK)
+                break;
+        }
+        if(rv != ETNA_OK)
+        {
+            fprintf(stderr, "etna_try_flush failed: %i\n", rv);
+            return 1;
+        }
+    }
+    alarm(0);
+    etna_free(ctx);
+    viv_close(conn);
+    printf("try_flush: %i iterations ok\n", CHECK_ITERATIONS);
+    return 0;
+}
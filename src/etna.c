@@ -23,8 +23,11 @@
 #include <etna.h>
 #include <etna_bo.h>
 #include <viv.h>
+#include <viv_capture.h>
 #include <etna_queue.h>
 #include <state.xml.h>
+#include <state_2d.xml.h>
+#include <state_3d.xml.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -38,15 +41,70 @@
 //#define DEBUG
 //#define DEBUG_CMDBUF
 
-/* Maximum number of flushes without queuing a signal (per command buffer).
+/* Default maximum number of flushes without queuing a signal (per command buffer).
    If this amount is reached, we roll to the next command buffer,
-   which automatically queues a signal.
+   which automatically queues a signal, or queue a signal with the commit
+   (see struct etna_flush_policy).
    XXX works around driver bug on (at least) cubox, for which drivers
-       is this not needed? Not urgent as this does not result in a
-       deducible performance impact.
+       is this not needed?
 */
 #define ETNA_MAX_UNSIGNALED_FLUSHES (40)
 
+/* Registers that trigger an action when written, instead of holding state.
+ * Writes to these are never dropped by the register shadow, nor restored
+ * by the state tracker.
+ */
+static const uint32_t etna_trigger_states[] = {
+    VIVS_FE_AUTO_FLUSH,
+    VIVS_GL_PIPE_SELECT,
+    VIVS_GL_EVENT,
+    VIVS_GL_SEMAPHORE_TOKEN,
+    VIVS_GL_FLUSH_CACHE,
+    VIVS_GL_FLUSH_MMU,
+    VIVS_GL_STALL_TOKEN,
+    VIVS_CL_KICKER,
+    VIVS_CO_KICKER,
+    VIVS_RS_KICKER,
+    VIVS_TS_FLUSH_CACHE,
+    VIVS_DE_DE_STALL_DE
+};
+
+/* All caches that can be flushed through VIVS_GL_FLUSH_CACHE */
+#define ETNA_CACHES_ALL (VIVS_GL_FLUSH_CACHE_DEPTH | VIVS_GL_FLUSH_CACHE_COLOR | \
+        VIVS_GL_FLUSH_CACHE_TEXTURE | VIVS_GL_FLUSH_CACHE_PE2D | VIVS_GL_FLUSH_CACHE_TEXTUREVS | \
+        VIVS_GL_FLUSH_CACHE_SHADER_L1 | VIVS_GL_FLUSH_CACHE_SHADER_L2)
+
+/* Whether writing trigger register address can start work that writes memory,
+ * as opposed to synchronizing or flushing */
+static bool trigger_writes_memory(uint32_t address)
+{
+    switch(address)
+    {
+    case VIVS_GL_PIPE_SELECT:
+    case VIVS_GL_EVENT:
+    case VIVS_GL_SEMAPHORE_TOKEN:
+    case VIVS_GL_FLUSH_CACHE:
+    case VIVS_GL_FLUSH_MMU:
+    case VIVS_GL_STALL_TOKEN:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/* Fill bitmask with all state words except trigger registers */
+static void init_state_mask(uint32_t *mask)
+{
+    memset(mask, 0xff, ETNA_NUM_STATES/8);
+    for(unsigned x=0; x<sizeof(etna_trigger_states)/sizeof(etna_trigger_states[0]); ++x)
+    {
+        uint32_t idx = etna_trigger_states[x] >> 2;
+        mask[idx >> 5] &= ~(1u << (idx & 31));
+    }
+}
+
+static int pipe_segments_write(struct etna_ctx *ctx);
+
 /* Initialize kernel GPU context (v2 only)
  * XXX move all this context handling stuff to a separate implementation file.
  */
@@ -86,7 +144,7 @@ static int gpu_context_initialize(struct etna_ctx *ctx)
     ctx->ctx = VIV_TO_HANDLE(vctx);
     /* Allocate initial context buffer */
     /*   XXX DRM_ETNA_GEM_CACHE_xxx */
-    if((ctx->ctx_bo = etna_bo_new(ctx->conn, COMMAND_BUFFER_SIZE, DRM_ETNA_GEM_TYPE_CMD)) == NULL)
+    if((ctx->ctx_bo = etna_bo_new(ctx->conn, ctx->buffer_size, DRM_ETNA_GEM_TYPE_CMD)) == NULL)
     {
         ETNA_FREE(vctx);
         return ETNA_OUT_OF_MEMORY;
@@ -99,7 +157,7 @@ static int gpu_context_initialize(struct etna_ctx *ctx)
 /* Clear GPU context, to rebuild it for next flush */
 static int gpu_context_clear(struct etna_ctx *ctx)
 {
-    /* If context was used, queue free it and allocate new buffer to prevent
+    /* If context was used, swap it for an idle buffer from the pool to prevent
      * overwriting it while being used by the GPU.  Otherwise we can just
      * re-use it.
      */
@@ -110,17 +168,52 @@ static int gpu_context_clear(struct etna_ctx *ctx)
     if(GCCTX(ctx)->inUse != NULL &&
        *GCCTX(ctx)->inUse)
     {
-#ifdef DEBUG
-        fprintf(stderr, "gpu_context_clear: context was in use, deferred freeing and reallocating it\n");
-#endif
-        if((rv = etna_bo_del(ctx->conn, ctx->ctx_bo, ctx->queue)) != ETNA_OK)
+        struct etna_ctx_pool_entry *entry = NULL;
+        /* Look for first pooled buffer that the GPU is done with */
+        for(int x=0; x<ctx->ctx_pool_count; ++x)
         {
-            return rv;
+            if(ctx->ctx_pool[x].in_use == NULL || *ctx->ctx_pool[x].in_use == 0)
+            {
+                entry = &ctx->ctx_pool[x];
+                break;
+            }
         }
-        if((ctx->ctx_bo = etna_bo_new(ctx->conn, COMMAND_BUFFER_SIZE, DRM_ETNA_GEM_TYPE_CMD)) == NULL)
+        if(entry != NULL)
         {
-            return ETNA_OUT_OF_MEMORY;
+#ifdef DEBUG
+            fprintf(stderr, "gpu_context_clear: context was in use, swapping with pooled buffer\n");
+#endif
+            struct etna_bo *bo = entry->bo;
+            entry->bo = ctx->ctx_bo;
+            entry->in_use = GCCTX(ctx)->inUse;
+            ctx->ctx_bo = bo;
+            ctx->stats.ctx_pool_hits += 1;
+        } else {
+            if(ctx->ctx_pool_count < ETNA_CTX_POOL_SIZE)
+            {
+#ifdef DEBUG
+                fprintf(stderr, "gpu_context_clear: context was in use, adding it to pool and allocating new buffer\n");
+#endif
+                entry = &ctx->ctx_pool[ctx->ctx_pool_count++];
+                entry->bo = ctx->ctx_bo;
+                entry->in_use = GCCTX(ctx)->inUse;
+            } else {
+#ifdef DEBUG
+                fprintf(stderr, "gpu_context_clear: context was in use and pool is busy, deferred freeing and reallocating it\n");
+#endif
+                if((rv = etna_bo_del(ctx->conn, ctx->ctx_bo, ctx->queue)) != ETNA_OK)
+                {
+                    return rv;
+                }
+            }
+            ctx->stats.ctx_pool_misses += 1;
+            if((ctx->ctx_bo = etna_bo_new(ctx->conn, ctx->buffer_size, DRM_ETNA_GEM_TYPE_CMD)) == NULL)
+            {
+                return ETNA_OUT_OF_MEMORY;
+            }
         }
+        /* inUse flag of new buffer will be placed by gpu_context_finish_up */
+        GCCTX(ctx)->inUse = NULL;
     }
     /* Leave space at beginning of buffer for PIPE switch */
     GCCTX(ctx)->bufferSize = BEGIN_COMMIT_CLEARANCE;
@@ -148,7 +241,7 @@ static int gpu_context_clear(struct etna_ctx *ctx)
  */
 static int gpu_context_build_start(struct etna_ctx *ctx)
 {
-    if(ctx->cur_buf == ETNA_CTX_BUFFER)
+    if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER)
         return ETNA_INTERNAL_ERROR;
     /* Save current buffer id and position */
     ctx->cmdbuf[ctx->cur_buf]->offset = ctx->offset * 4;
@@ -158,6 +251,9 @@ static int gpu_context_build_start(struct etna_ctx *ctx)
     ctx->cur_buf = ETNA_CTX_BUFFER;
     ctx->buf = GCCTX(ctx)->logical;
     ctx->offset = GCCTX(ctx)->bufferSize / 4;
+    ctx->stored_buffer_size = ctx->buffer_size;
+    ctx->buffer_size = etna_bo_size(ctx->ctx_bo);
+    ctx->draw_buf = NULL;
 
     return ETNA_OK;
 }
@@ -180,9 +276,11 @@ static int gpu_context_build_end(struct etna_ctx *ctx, enum etna_pipe final_pipe
     /* Set current size -- finishing up context before flush
      * will add space for a LINK command and inUse flag.
      */
+    ETNA_ALIGN(ctx);
     GCCTX(ctx)->bufferSize = ctx->offset * 4;
 
     /* Switch back to stored buffer */
+    ctx->buffer_size = ctx->stored_buffer_size;
     ctx->cur_buf = ctx->stored_buf;
     ctx->buf = VIV_TO_PTR(ctx->cmdbuf[ctx->cur_buf]->logical);
     ctx->offset = ctx->cmdbuf[ctx->cur_buf]->offset / 4;
@@ -212,6 +310,125 @@ static int gpu_context_finish_up(struct etna_ctx *ctx)
     return ETNA_OK;
 }
 
+/** Lay out LOAD_STATE commands for all touched state words in the tracker
+ * image, one section per pipe, with one command per run of consecutive words
+ * with the same FIXP flag.
+ */
+static int tracker_layout(struct etna_state_tracker *tracker)
+{
+    uint32_t touched = 0;
+    uint32_t words = 0;
+    for(unsigned x=0; x<ETNA_NUM_STATES/32; ++x)
+        touched += __builtin_popcount(tracker->touched[x]);
+    /* worst case: header, value and padding for every word */
+    if(tracker->image_capacity < touched*3)
+    {
+        uint32_t *image = realloc(tracker->image, touched*3*4);
+        if(image == NULL)
+            return ETNA_OUT_OF_MEMORY;
+        tracker->image = image;
+        tracker->image_capacity = touched*3;
+    }
+#define TRACKER_BIT(mask, i) ((tracker->mask[(i) >> 5] >> ((i) & 31)) & 1)
+    for(uint32_t pipe=0; pipe<ETNA_NUM_PIPES; ++pipe)
+    {
+        uint32_t idx = 0;
+        tracker->pipe_start[pipe] = words;
+        while(idx < ETNA_NUM_STATES)
+        {
+            uint32_t in_pipe = (pipe == ETNA_PIPE_2D) ? tracker->pipe2d[idx >> 5] : ~tracker->pipe2d[idx >> 5];
+            uint32_t bits = (tracker->touched[idx >> 5] & in_pipe) >> (idx & 31);
+            if(bits == 0) /* skip rest of mask word */
+            {
+                idx = (idx | 31) + 1;
+                continue;
+            }
+            idx += __builtin_ctz(bits);
+            uint32_t start = idx;
+            uint32_t hdr = words++;
+            uint32_t fixp = TRACKER_BIT(fixp, idx);
+            while(idx < ETNA_NUM_STATES && (idx - start) < ETNA_COALESCE_MAX_COUNT &&
+                  TRACKER_BIT(touched, idx) && TRACKER_BIT(pipe2d, idx) == (pipe == ETNA_PIPE_2D) &&
+                  TRACKER_BIT(fixp, idx) == fixp)
+            {
+                tracker->pos[idx] = words;
+                tracker->image[words++] = tracker->values[idx];
+                ++idx;
+            }
+            tracker->image[hdr] = VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE |
+                (fixp ? VIV_FE_LOAD_STATE_HEADER_FIXP : 0) |
+                VIV_FE_LOAD_STATE_HEADER_OFFSET(start) |
+                (VIV_FE_LOAD_STATE_HEADER_COUNT(idx - start) & VIV_FE_LOAD_STATE_HEADER_COUNT__MASK);
+            if(words & 1) /* keep commands 64-bit aligned */
+                tracker->image[words++] = 0;
+        }
+        tracker->pipe_words[pipe] = words - tracker->pipe_start[pipe];
+    }
+#undef TRACKER_BIT
+    tracker->image_words = words;
+    tracker->layout_dirty = false;
+    return ETNA_OK;
+}
+
+/* Words emitted by etna_set_pipe: cache flush, stall and pipe select */
+#define PIPE_SWITCH_WORDS (8)
+
+/** Replace the (idle) context buffer by one of at least bytes bytes.
+ */
+static int gpu_context_resize(struct etna_ctx *ctx, uint32_t bytes)
+{
+    struct etna_bo *bo = etna_bo_new(ctx->conn, (bytes + 4095) & ~4095, DRM_ETNA_GEM_TYPE_CMD);
+    if(bo == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    etna_bo_del(ctx->conn, ctx->ctx_bo, NULL);
+    ctx->ctx_bo = bo;
+    GCCTX(ctx)->logical = etna_bo_map(ctx->ctx_bo);
+#ifdef GCABI_CONTEXT_HAS_PHYSICAL
+    GCCTX(ctx)->bytes = etna_bo_size(ctx->ctx_bo);
+    GCCTX(ctx)->physical = HANDLE_TO_VIV(etna_bo_gpu_address(ctx->ctx_bo));
+#endif
+    return ETNA_OK;
+}
+
+/** Build GPU context from tracked state. The sections of the pipe other than
+ * the entry pipe come first, so that the context ends in the entry pipe.
+ * The context buffer is grown if the image does not fit; if that fails, the
+ * context is left empty.
+ */
+static int tracker_build_context(struct etna_ctx *ctx)
+{
+    struct etna_state_tracker *tracker = ctx->tracker;
+    enum etna_pipe entry_pipe = GCCTX(ctx)->entryPipe;
+    enum etna_pipe pipe = entry_pipe;
+    bool first = true;
+    int status;
+    if(tracker->layout_dirty && (status = tracker_layout(tracker)) != ETNA_OK)
+        return status;
+    uint32_t bytes = GCCTX(ctx)->bufferSize + (tracker->image_words + ETNA_NUM_PIPES*PIPE_SWITCH_WORDS)*4 +
+                     END_COMMIT_CLEARANCE;
+    if(bytes > etna_bo_size(ctx->ctx_bo) && (status = gpu_context_resize(ctx, bytes)) != ETNA_OK)
+        return status;
+    if((status = gpu_context_build_start(ctx)) != ETNA_OK)
+        return status;
+    for(int x=0; x<ETNA_NUM_PIPES; ++x)
+    {
+        enum etna_pipe section = (x == ETNA_NUM_PIPES - 1) ? entry_pipe : !entry_pipe;
+        if(tracker->pipe_words[section] == 0)
+            continue;
+        if(first)
+            GCCTX(ctx)->initialPipe = section;
+        else if(section != pipe && (status = etna_set_pipe(ctx, section)) != ETNA_OK)
+            break;
+        pipe = section;
+        first = false;
+        memcpy(&ctx->buf[ctx->offset], &tracker->image[tracker->pipe_start[section]],
+               tracker->pipe_words[section]*4);
+        ctx->offset += tracker->pipe_words[section];
+    }
+    gpu_context_build_end(ctx, pipe);
+    return status;
+}
+
 #else
 
 #define GCCTX(x) ((gckCONTEXT)((x)->ctx))
@@ -258,16 +475,113 @@ static int gpu_context_free(struct etna_ctx *ctx)
 }
 #endif
 
+static int bo_list_push(struct etna_bo_list *list, struct etna_bo *bo)
+{
+    if(list->num == list->max)
+    {
+        int max = list->max ? list->max * 2 : 4;
+        struct etna_bo **bos = realloc(list->bos, max * sizeof(struct etna_bo *));
+        if(bos == NULL)
+            return ETNA_OUT_OF_MEMORY;
+        list->bos = bos;
+        list->max = max;
+    }
+    list->bos[list->num++] = bo;
+    return ETNA_OK;
+}
+
+static void bo_list_free(struct etna_ctx *ctx, struct etna_bo_list *list)
+{
+    for(int x=0; x<list->num; ++x)
+        etna_bo_del(ctx->conn, list->bos[x], NULL);
+    free(list->bos);
+    memset(list, 0, sizeof(*list));
+}
+
+/* Allocate command buffer x, and create a synchronization signal for it.
+ * If ready is set, also signal the synchronization signal to tell that the buffer
+ * is ready for use.
+ */
+static int cmdbuf_allocate(struct etna_ctx *ctx, int x, bool ready)
+{
+    ctx->cmdbuf[x] = ETNA_CALLOC_STRUCT(_gcoCMDBUF);
+    if(ctx->cmdbuf[x] == NULL ||
+       (ctx->cmdbufi[x].bo = etna_bo_new(ctx->conn, ctx->buffer_size, DRM_ETNA_GEM_TYPE_CMD))==NULL)
+    {
+#ifdef DEBUG
+        fprintf(stderr, "Error allocating host memory for command buffer\n");
+#endif
+        return ETNA_OUT_OF_MEMORY;
+    }
+    ctx->cmdbuf[x]->object.type = gcvOBJ_COMMANDBUFFER;
+#ifdef GCABI_CMDBUF_HAS_PHYSICAL
+    ctx->cmdbuf[x]->physical = PTR_TO_VIV((void*)etna_bo_gpu_address(ctx->cmdbufi[x].bo));
+    ctx->cmdbuf[x]->bytes = etna_bo_size(ctx->cmdbufi[x].bo);
+#endif
+    ctx->cmdbuf[x]->logical = PTR_TO_VIV((void*)etna_bo_map(ctx->cmdbufi[x].bo));
+
+    if(viv_user_signal_create(ctx->conn, 0, &ctx->cmdbufi[x].sig_id) != 0)
+    {
+#ifdef DEBUG
+        fprintf(stderr, "Cannot create user signal\n");
+#endif
+        return ETNA_INTERNAL_ERROR;
+    }
+    if(ready && viv_user_signal_signal(ctx->conn, ctx->cmdbufi[x].sig_id, 1) != 0)
+    {
+#ifdef DEBUG
+        fprintf(stderr, "Cannot signal user signal\n");
+#endif
+        viv_user_signal_destroy(ctx->conn, ctx->cmdbufi[x].sig_id);
+        return ETNA_INTERNAL_ERROR;
+    }
+#ifdef DEBUG
+    fprintf(stderr, "Allocated buffer %i: phys=%08x log=%08x bytes=%08x [signal %i]\n", x,
+            (uint32_t)ctx->cmdbuf[x]->physical, (uint32_t)ctx->cmdbuf[x]->logical, ctx->cmdbuf[x]->bytes, ctx->cmdbufi[x].sig_id);
+#endif
+    return ETNA_OK;
+}
+
 int etna_create(struct viv_conn *conn, struct etna_ctx **ctx_out)
+{
+    struct etna_ctx_config config = {
+        .num_buffers = NUM_COMMAND_BUFFERS,
+        .buffer_size = COMMAND_BUFFER_SIZE,
+        .max_buffers = 0,
+        .grow_threshold = 0
+    };
+    return etna_create_config(conn, &config, ctx_out);
+}
+
+int etna_create_config(struct viv_conn *conn, const struct etna_ctx_config *config, struct etna_ctx **ctx_out)
 {
     int rv;
-    if(ctx_out == NULL) return ETNA_INVALID_ADDR;
+    if(ctx_out == NULL || config == NULL) return ETNA_INVALID_ADDR;
+    if(config->num_buffers < 2 || config->buffer_size < MIN_COMMAND_BUFFER_SIZE ||
+       (config->buffer_size & 7) != 0)
+        return ETNA_INVALID_VALUE;
     struct etna_ctx *ctx = ETNA_CALLOC_STRUCT(etna_ctx);
     if(ctx == NULL) return ETNA_OUT_OF_MEMORY;
     ctx->conn = conn;
+    ctx->buffer_size = config->buffer_size;
+    ctx->num_buffers = config->num_buffers;
+    ctx->max_buffers = etna_umax(config->max_buffers, config->num_buffers);
+    ctx->grow_threshold = etna_umax(config->grow_threshold, 1);
+    ctx->cmdbuf = ETNA_CALLOC_STRUCT_ARRAY(ctx->max_buffers, _gcoCMDBUF *);
+    ctx->cmdbufi = ETNA_CALLOC_STRUCT_ARRAY(ctx->max_buffers, etna_cmdbuf);
+    if(ctx->cmdbuf == NULL || ctx->cmdbufi == NULL)
+    {
+        ETNA_FREE(ctx->cmdbuf);
+        ETNA_FREE(ctx->cmdbufi);
+        ETNA_FREE(ctx);
+        return ETNA_OUT_OF_MEMORY;
+    }
 
     if(gpu_context_initialize(ctx) != ETNA_OK)
     {
+        /* no command buffers have been allocated yet */
+        ETNA_FREE(ctx->cmdbuf);
+        ETNA_FREE(ctx->cmdbufi);
         ETNA_FREE(ctx);
         return ETNA_INTERNAL_ERROR;
     }
@@ -284,38 +598,21 @@ int etna_create(struct viv_conn *conn, struct etna_ctx **ctx_out)
     fprintf(stderr, "Created user signal %i\n", ctx->sig_id);
 #endif
 
-    /* Allocate command buffers, and create a synchronization signal for each.
-     * Also signal the synchronization signal for the buffers to tell that the buffers are ready for use.
-     */
-    for(int x=0; x<NUM_COMMAND_BUFFERS; ++x)
+    /* Create signal queued to keep commits from going unsignalled; never waited on */
+    if(viv_user_signal_create(conn, 0, &ctx->flush_sig_id) != 0)
     {
-        ctx->cmdbuf[x] = ETNA_CALLOC_STRUCT(_gcoCMDBUF);
-        if((ctx->cmdbufi[x].bo = etna_bo_new(conn, COMMAND_BUFFER_SIZE, DRM_ETNA_GEM_TYPE_CMD))==NULL)
-        {
 #ifdef DEBUG
-            fprintf(stderr, "Error allocating host memory for command buffer\n");
-#endif
-            return ETNA_OUT_OF_MEMORY;
-        }
-        ctx->cmdbuf[x]->object.type = gcvOBJ_COMMANDBUFFER;
-#ifdef GCABI_CMDBUF_HAS_PHYSICAL
-        ctx->cmdbuf[x]->physical = PTR_TO_VIV((void*)etna_bo_gpu_address(ctx->cmdbufi[x].bo));
-        ctx->cmdbuf[x]->bytes = ctx->cmdbufi[x].bytes;
+        fprintf(stderr, "Cannot create user signal\n");
 #endif
-        ctx->cmdbuf[x]->logical = PTR_TO_VIV((void*)etna_bo_map(ctx->cmdbufi[x].bo));
+        return ETNA_INTERNAL_ERROR;
+    }
+    etna_get_default_flush_policy(conn, &ctx->flush_policy);
 
-        if(viv_user_signal_create(conn, 0, &ctx->cmdbufi[x].sig_id) != 0 ||
-           viv_user_signal_signal(conn, ctx->cmdbufi[x].sig_id, 1) != 0)
-        {
-#ifdef DEBUG
-            fprintf(stderr, "Cannot create user signal\n");
-#endif
-            return ETNA_INTERNAL_ERROR;
-        }
-#ifdef DEBUG
-        fprintf(stderr, "Allocated buffer %i: phys=%08x log=%08x bytes=%08x [signal %i]\n", x,
-                (uint32_t)ctx->cmdbuf[x]->physical, (uint32_t)ctx->cmdbuf[x]->logical, ctx->cmdbuf[x]->bytes, ctx->cmdbufi[x].sig_id);
-#endif
+    /* Allocate command buffers */
+    for(int x=0; x<ctx->num_buffers; ++x)
+    {
+        if((rv = cmdbuf_allocate(ctx, x, true)) != ETNA_OK)
+            return rv;
     }
 
     /* Allocate command queue */
@@ -331,6 +628,10 @@ int etna_create(struct viv_conn *conn, struct etna_ctx **ctx_out)
      * queueing of commands can be started.
      */
     ctx->cur_buf = ETNA_NO_BUFFER;
+    ctx->next_buf_acquired = ETNA_NO_BUFFER;
+    ctx->cur_pipe = -1;
+    ctx->busy_units = ETNA_UNITS_ALL;
+    ctx->dirty_caches = ETNA_CACHES_ALL;
 
     *ctx_out = ctx;
     return ETNA_OK;
@@ -344,52 +645,200 @@ static void clear_buffer(gcoCMDBUF cmdbuf)
     cmdbuf->offset = BEGIN_COMMIT_CLEARANCE;
 }
 
-/* Switch to next buffer, optionally wait for it to be available */
-static int switch_next_buffer(struct etna_ctx *ctx)
+/* Insert a new command buffer into the ring after the current one.
+ * @return OK on success, error code otherwise
+ */
+static int grow_ring(struct etna_ctx *ctx)
 {
-    int next_buf_id = (ctx->cur_buf + 1) % NUM_COMMAND_BUFFERS;
-#if 0
-    fprintf(stderr, "Switching to new buffer %i\n", next_buf_id);
+    int pos = ctx->cur_buf + 1;
+    int rv;
+    /* Make room at pos; buffers keep their own signal, so ring order does not matter */
+    memmove(&ctx->cmdbuf[pos + 1], &ctx->cmdbuf[pos], (ctx->num_buffers - pos) * sizeof(ctx->cmdbuf[0]));
+    memmove(&ctx->cmdbufi[pos + 1], &ctx->cmdbufi[pos], (ctx->num_buffers - pos) * sizeof(ctx->cmdbufi[0]));
+    ctx->cmdbuf[pos] = NULL;
+    memset(&ctx->cmdbufi[pos], 0, sizeof(ctx->cmdbufi[pos]));
+    ctx->num_buffers += 1;
+    /* The new buffer is handed out right away, so don't signal it ready: a
+     * stale signal would let the buffer be reused while the GPU executes it */
+    if((rv = cmdbuf_allocate(ctx, pos, false)) != ETNA_OK)
+    {
+        /* Undo, and continue with the buffers we have (cmdbuf_allocate does
+         * not leave a signal behind on failure) */
+        etna_bo_del(ctx->conn, ctx->cmdbufi[pos].bo, NULL);
+        ETNA_FREE(ctx->cmdbuf[pos]);
+        ctx->num_buffers -= 1;
+        memmove(&ctx->cmdbuf[pos], &ctx->cmdbuf[pos + 1], (ctx->num_buffers - pos) * sizeof(ctx->cmdbuf[0]));
+        memmove(&ctx->cmdbufi[pos], &ctx->cmdbufi[pos + 1], (ctx->num_buffers - pos) * sizeof(ctx->cmdbufi[0]));
+        return rv;
+    }
+#ifdef DEBUG
+    fprintf(stderr, "Grew command buffer ring to %i buffers\n", ctx->num_buffers);
 #endif
-    if(viv_user_signal_wait(ctx->conn, ctx->cmdbufi[next_buf_id].sig_id, VIV_WAIT_INDEFINITE) != 0)
+    return ETNA_OK;
+}
+
+/* Find the next command buffer in the ring that is available for writing, adding
+ * a buffer to the ring if the next one was in use by the GPU often enough.
+ * If block is false, return ETNA_WOULD_BLOCK instead of waiting for the GPU.
+ */
+static int acquire_next_buffer(struct etna_ctx *ctx, bool block, int *buf_id_out)
+{
+    if(ctx->next_buf_acquired != ETNA_NO_BUFFER)
+    {
+        /* Signal was consumed by an earlier poll; don't wait for it again */
+        *buf_id_out = ctx->next_buf_acquired;
+        ctx->next_buf_acquired = ETNA_NO_BUFFER;
+        return ETNA_OK;
+    }
+    int next_buf_id = (ctx->cur_buf + 1) % ctx->num_buffers;
+    bool can_grow = ctx->num_buffers < ctx->max_buffers && ctx->cur_buf != ETNA_NO_BUFFER;
+    if(can_grow || !block)
+    {
+        /* Poll next buffer; if it is still in use by the GPU often enough,
+         * add a fresh buffer to the ring instead of waiting. */
+        if(viv_user_signal_wait(ctx->conn, ctx->cmdbufi[next_buf_id].sig_id, 0) == VIV_STATUS_OK)
+        {
+            *buf_id_out = next_buf_id;
+            return ETNA_OK;
+        }
+        if(can_grow && ++ctx->blocked_switches >= ctx->grow_threshold && grow_ring(ctx) == ETNA_OK)
+        {
+            ctx->blocked_switches = 0;
+            *buf_id_out = ctx->cur_buf + 1;
+            return ETNA_OK;
+        }
+        if(!block)
+            return ETNA_WOULD_BLOCK;
+    }
+    uint64_t start = etna_time_ns();
+    int rv = viv_user_signal_wait(ctx->conn, ctx->cmdbufi[next_buf_id].sig_id, VIV_WAIT_INDEFINITE);
+    ctx->stats.blocked_ns[ETNA_WAIT_BUFFER_SWITCH] += etna_time_ns() - start;
+    if(rv != 0)
     {
 #ifdef DEBUG
         fprintf(stderr, "Error waiting for command buffer sync signal\n");
 #endif
         return ETNA_INTERNAL_ERROR;
     }
+    *buf_id_out = next_buf_id;
+    return ETNA_OK;
+}
+
+static void switch_to_buffer(struct etna_ctx *ctx, int next_buf_id)
+{
+#if 0
+    fprintf(stderr, "Switching to new buffer %i\n", next_buf_id);
+#endif
+    struct etna_bo_list *chain_bos = &ctx->cmdbufi[next_buf_id].chain_bos;
     clear_buffer(ctx->cmdbuf[next_buf_id]);
+    /* The GPU is done with the buffer, and so with the segments chained from it */
+    for(int x=0; x<chain_bos->num; ++x)
+    {
+        if(bo_list_push(&ctx->chain_pool, chain_bos->bos[x]) != ETNA_OK)
+            etna_bo_del(ctx->conn, chain_bos->bos[x], NULL);
+    }
+    chain_bos->num = 0;
+    ctx->stats.buffer_switches += 1;
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+    ctx->num_pending_calls = 0;
     ctx->cur_buf = next_buf_id;
     ctx->buf = VIV_TO_PTR(ctx->cmdbuf[next_buf_id]->logical);
     ctx->offset = ctx->cmdbuf[next_buf_id]->offset / 4;
 #ifdef DEBUG
     fprintf(stderr, "Switched to command buffer %i\n", ctx->cur_buf);
 #endif
+}
+
+/* Direct commands to the segment of pipe, instead of the command buffer */
+static int pipe_segment_enter(struct etna_ctx *ctx, int pipe)
+{
+    struct etna_pipe_segment *seg = &ctx->pipe_seg[pipe];
+    if(seg->buf == NULL)
+    {
+        if((seg->buf = ETNA_MALLOC(MIN_COMMAND_BUFFER_SIZE)) == NULL)
+            return ETNA_OUT_OF_MEMORY;
+        seg->size = MIN_COMMAND_BUFFER_SIZE;
+        seg->offset = 0;
+    }
+    ctx->stored_buf = ctx->cur_buf;
+    ctx->stored_ptr = ctx->buf;
+    ctx->stored_offset = ctx->offset;
+    ctx->stored_buffer_size = ctx->buffer_size;
+    ctx->cur_buf = ETNA_FRAGMENT_BUFFER;
+    ctx->buf = seg->buf;
+    ctx->offset = seg->offset;
+    ctx->buffer_size = seg->size;
+    ctx->record_pipe = pipe;
+    ctx->pipe_seg_active = true;
+    /* Writes will be re-ordered relative to the other pipe */
+    if(ctx->shadow)
+        memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
     return ETNA_OK;
 }
 
+/* Save position in current pipe segment, and go back to the command buffer */
+static void pipe_segment_leave(struct etna_ctx *ctx)
+{
+    struct etna_pipe_segment *seg = &ctx->pipe_seg[ctx->record_pipe];
+    ETNA_ALIGN(ctx);
+    seg->buf = ctx->buf; /* may have been grown */
+    seg->offset = ctx->offset;
+    seg->size = ctx->buffer_size;
+    ctx->cur_buf = ctx->stored_buf;
+    ctx->buf = ctx->stored_ptr;
+    ctx->offset = ctx->stored_offset;
+    ctx->buffer_size = ctx->stored_buffer_size;
+    ctx->pipe_seg_active = false;
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+}
+
 int etna_free(struct etna_ctx *ctx)
 {
     if(ctx == NULL)
         return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf == ETNA_FRAGMENT_BUFFER && !ctx->pipe_seg_active)
+        return etna_fragment_free(ctx);
+    /* Commands still deferred are dropped */
+    if(ctx->pipe_seg_active)
+        pipe_segment_leave(ctx);
+    for(int x=0; x<ETNA_NUM_PIPES; ++x)
+        ETNA_FREE(ctx->pipe_seg[x].buf);
+    /* Make sure nothing referencing our buffers is waiting for submission */
+    if(ctx->async)
+        viv_async_drain(ctx->conn);
     /* Free kernel command queue */
     etna_queue_free(ctx->queue);
 #ifdef GCABI_HAS_CONTEXT
-    /* Free context buffer */
+    /* Free context buffers */
     etna_bo_del(ctx->conn, ctx->ctx_bo, NULL);
+    for(int x=0; x<ctx->ctx_pool_count; ++x)
+        etna_bo_del(ctx->conn, ctx->ctx_pool[x].bo, NULL);
 #endif
     /* Free command buffers */
-    for(int x=0; x<NUM_COMMAND_BUFFERS; ++x)
+    for(int x=0; x<ctx->num_buffers; ++x)
     {
         viv_user_signal_destroy(ctx->conn, ctx->cmdbufi[x].sig_id);
         etna_bo_del(ctx->conn, ctx->cmdbufi[x].bo, NULL);
+        bo_list_free(ctx, &ctx->cmdbufi[x].chain_bos);
         ETNA_FREE(ctx->cmdbuf[x]);
     }
+    ETNA_FREE(ctx->cmdbuf);
+    ETNA_FREE(ctx->cmdbufi);
     viv_user_signal_destroy(ctx->conn, ctx->sig_id);
+    viv_user_signal_destroy(ctx->conn, ctx->flush_sig_id);
 #ifndef GCABI_HAS_CONTEXT
     gpu_context_free(ctx);
 #endif
 
+    bo_list_free(ctx, &ctx->chain_bos);
+    bo_list_free(ctx, &ctx->chain_pool);
+    ETNA_FREE(ctx->shadow);
+    etna_set_state_tracking(ctx, false);
+    ETNA_FREE(ctx->block_buf);
     ETNA_FREE(ctx);
     return ETNA_OK;
 }
@@ -399,13 +848,124 @@ int etna_free(struct etna_ctx *ctx)
  * - signify when current command buffer becomes available using a signal
  * - switch to next command buffer
  */
-int _etna_reserve_internal(struct etna_ctx *ctx, size_t n)
+/* Grow fragment arena so that n more words fit */
+static int fragment_grow(struct etna_ctx *ctx, size_t n)
+{
+    uint32_t size = ctx->buffer_size;
+    while(((ctx->offset + n)*4 + END_COMMIT_CLEARANCE) > size)
+        size *= 2;
+    uint32_t *buf = realloc(ctx->buf, size);
+    if(buf == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    ctx->buf = buf;
+    ctx->buffer_size = size;
+    return ETNA_OK;
+}
+
+/* Would committing now be one commit without signal too many? */
+static inline bool flush_limit_reached(struct etna_ctx *ctx)
+{
+    return ctx->flush_policy.max_unsignaled_flushes &&
+           ctx->flushes >= ctx->flush_policy.max_unsignaled_flushes;
+}
+
+/* Number of bytes available in the current buffer after committing up to
+ * (word) offset */
+static uint32_t bytes_left_after_flush(struct etna_ctx *ctx, uint32_t offset)
+{
+    uint32_t next_offset = ((offset + 1) & ~1)*4 + END_COMMIT_CLEARANCE + BEGIN_COMMIT_CLEARANCE;
+    if((next_offset + END_COMMIT_CLEARANCE) >= ctx->buffer_size)
+        return 0;
+    return ctx->buffer_size - END_COMMIT_CLEARANCE - next_offset;
+}
+
+/* Fill in return prefetch of CALLs in the current buffer. Block CALLs return to
+ * the command following them, fetch up to and including the LINK at offset end
+ * (which the kernel appends at the end of a commit, or that leads to a chained
+ * segment) */
+static void patch_pending_calls(struct etna_ctx *ctx, uint32_t end)
+{
+    for(int x=0; x<ctx->num_pending_calls; ++x)
+    {
+        uint32_t ret = ctx->pending_calls[x] + 4;
+        ctx->buf[ctx->pending_calls[x] + 2] = (end - ret)/2 + 1;
+    }
+    ctx->num_pending_calls = 0;
+}
+
+/* Continue writing in a new segment, big enough for n words, that is linked to
+ * from the current position.
+ */
+static int chain_next_segment(struct etna_ctx *ctx, size_t n)
+{
+    struct etna_bo *bo;
+    ETNA_ALIGN(ctx);
+    if((n*4 + END_COMMIT_CLEARANCE) > ctx->buffer_size)
+        return ETNA_OUT_OF_MEMORY;
+    /* kernel appends its LINK just past the LINK to the first segment */
+    if(ctx->chain_link == NULL &&
+       ((ctx->offset + 2)*4 + END_COMMIT_CLEARANCE) > ctx->buffer_size)
+        return ETNA_OUT_OF_MEMORY;
+    if(ctx->chain_pool.num > 0)
+        bo = ctx->chain_pool.bos[--ctx->chain_pool.num];
+    else if((bo = etna_bo_new(ctx->conn, ctx->buffer_size, DRM_ETNA_GEM_TYPE_CMD)) == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    if(bo_list_push(&ctx->chain_bos, bo) != ETNA_OK)
+    {
+        etna_bo_del(ctx->conn, bo, NULL);
+        return ETNA_OUT_OF_MEMORY;
+    }
+#ifdef DEBUG
+    fprintf(stderr, "Chaining command buffer %i to segment %i\n", ctx->cur_buf, ctx->chain_bos.num - 1);
+#endif
+    patch_pending_calls(ctx, ctx->offset);
+    if(ctx->chain_link == NULL) /* leaving command buffer */
+    {
+        ctx->chain_return = ctx->offset + 2;
+    } else { /* current segment ends with this LINK */
+        *ctx->chain_link |= VIV_FE_LINK_HEADER_PREFETCH(ctx->offset/2 + 1);
+        ctx->stats.chained_bytes += (ctx->offset + 2)*4;
+        ctx->stats.wasted_bytes += ctx->buffer_size - (ctx->offset + 2)*4;
+    }
+    ctx->chain_link = &ctx->buf[ctx->offset];
+    ETNA_EMIT(ctx, VIV_FE_LINK_HEADER_OP_LINK);
+    ETNA_EMIT(ctx, etna_bo_gpu_address(bo));
+    ctx->buf = etna_bo_map(bo);
+    ctx->offset = 0;
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+    return ETNA_OK;
+}
+
+/* End the last segment with a LINK back to the command buffer, and continue
+ * writing there. */
+static void chain_close(struct etna_ctx *ctx)
+{
+    ETNA_ALIGN(ctx);
+    patch_pending_calls(ctx, ctx->offset);
+    *ctx->chain_link |= VIV_FE_LINK_HEADER_PREFETCH(ctx->offset/2 + 1);
+    ctx->stats.chained_bytes += (ctx->offset + 2)*4;
+    ctx->stats.wasted_bytes += ctx->buffer_size - (ctx->offset + 2)*4;
+    /* only fetch the area reserved for the commands the kernel appends there */
+    ETNA_EMIT(ctx, VIV_FE_LINK_HEADER_OP_LINK | VIV_FE_LINK_HEADER_PREFETCH(END_COMMIT_CLEARANCE/8));
+    ETNA_EMIT(ctx, etna_bo_gpu_address(ctx->cmdbufi[ctx->cur_buf].bo) + ctx->chain_return*4);
+    ctx->chain_link = NULL;
+    ctx->buf = VIV_TO_PTR(ctx->cmdbuf[ctx->cur_buf]->logical);
+    ctx->offset = ctx->chain_return;
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+}
+
+static int reserve_internal(struct etna_ctx *ctx, size_t n, bool block)
 {
     int status;
+    int next_buf_id;
 #ifdef DEBUG
     fprintf(stderr, "Buffer full\n");
 #endif
-    if((ctx->offset*4 + END_COMMIT_CLEARANCE) > COMMAND_BUFFER_SIZE)
+    if(ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+        return fragment_grow(ctx, n);
+    if((ctx->offset*4 + END_COMMIT_CLEARANCE) > ctx->buffer_size)
     {
         fprintf(stderr, "%s: Command buffer overflow! This is likely a programming error in the GPU driver.\n", __func__);
         abort();
@@ -417,11 +977,27 @@ int _etna_reserve_internal(struct etna_ctx *ctx, size_t n)
         abort();
     }
 #endif
+    if(ctx->cur_buf == ETNA_BLOCK_BUFFER)
+    {
+        fprintf(stderr, "%s: Command block overflow! This is likely a programming error in the GPU driver.\n", __func__);
+        abort();
+    }
+    if(ctx->chain && ctx->cur_buf != ETNA_NO_BUFFER &&
+       chain_next_segment(ctx, n) == ETNA_OK)
+    {
+        return ETNA_OK;
+    }
+    /* When not blocking, make sure there is a buffer to switch to before
+     * committing; otherwise commit first to keep the GPU busy while waiting */
+    if(!block && (status = acquire_next_buffer(ctx, false, &next_buf_id)) != ETNA_OK)
+        return status;
     if(ctx->cur_buf != ETNA_NO_BUFFER)
     {
 #if 0
         fprintf(stderr, "Submitting old buffer %i\n", ctx->cur_buf);
 #endif
+        uint32_t used = (ctx->chain_link != NULL) ? ctx->chain_return : ((ctx->offset + 1) & ~1);
+        ctx->stats.wasted_bytes += ctx->buffer_size - END_COMMIT_CLEARANCE - used*4;
         /* Queue signal to signify when buffer is available again */
         if((status = etna_queue_signal(ctx->queue, ctx->cmdbufi[ctx->cur_buf].sig_id, VIV_WHERE_COMMAND)) != ETNA_OK)
         {
@@ -437,12 +1013,82 @@ int _etna_reserve_internal(struct etna_ctx *ctx, size_t n)
     }
 
     /* Move on to next buffer if not enough free in current one */
-    if((status = switch_next_buffer(ctx)) != ETNA_OK)
+    if(block && (status = acquire_next_buffer(ctx, true, &next_buf_id)) != ETNA_OK)
     {
         fprintf(stderr, "%s: can't switch to next command buffer: %i\n", __func__, status);
         abort(); /* Buffer is in invalid state XXX need some kind of recovery.
                     This could involve waiting and re-uploading the context state. */
     }
+    switch_to_buffer(ctx, next_buf_id);
+    return ETNA_OK;
+}
+
+int _etna_reserve_internal(struct etna_ctx *ctx, size_t n)
+{
+    return reserve_internal(ctx, n, true);
+}
+
+int etna_try_reserve(struct etna_ctx *ctx, size_t n)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf != ETNA_NO_BUFFER)
+    {
+        ETNA_ALIGN(ctx);
+        if(((ctx->offset + n)*4 + END_COMMIT_CLEARANCE) <= ctx->buffer_size)
+            return ETNA_OK;
+    }
+    return reserve_internal(ctx, n, false);
+}
+
+/* Submit command buffer (NULL for only events) and event queue to the kernel,
+ * or hand them off to the submission thread in asynchronous mode.
+ * The fence mutex is taken unless this thread already holds it, which is
+ * also the case in a flush nested in a fenced one (when the queue overflows).
+ */
+static int commit_buffer_untimed(struct etna_ctx *ctx, gcoCMDBUF cmdbuf, struct _gcsQUEUE *queue)
+{
+    bool locked = ctx->fence_locked;
+    int status;
+    if(ctx->async)
+    {
+        /* The fence mutex serializes producers of the submission ring */
+        if(!locked)
+            pthread_mutex_lock(&ctx->conn->fence_mutex);
+        status = viv_commit_async(ctx->conn, cmdbuf, ctx->ctx, queue);
+        if(!locked)
+            pthread_mutex_unlock(&ctx->conn->fence_mutex);
+        return status;
+    }
+    /* Another context may start the submission thread at any time */
+    if(__atomic_load_n(&ctx->conn->async, __ATOMIC_ACQUIRE) != NULL)
+    {
+        /* Another context on this connection submits asynchronously. Wait for
+         * its queued commits to be submitted first, so that the kernel sees
+         * commits (and thus fences) in order. */
+        if(!locked)
+            pthread_mutex_lock(&ctx->conn->fence_mutex);
+        _viv_async_wait(ctx->conn);
+        status = (cmdbuf == NULL) ? viv_event_commit(ctx->conn, queue) :
+                                    viv_commit(ctx->conn, cmdbuf, ctx->ctx, queue);
+        if(!locked)
+            pthread_mutex_unlock(&ctx->conn->fence_mutex);
+        return status;
+    }
+    if(cmdbuf == NULL)
+        return viv_event_commit(ctx->conn, queue);
+    return viv_commit(ctx->conn, cmdbuf, ctx->ctx, queue);
+}
+
+static int commit_buffer(struct etna_ctx *ctx, gcoCMDBUF cmdbuf, struct _gcsQUEUE *queue)
+{
+    uint64_t start = etna_time_ns();
+    int status = commit_buffer_untimed(ctx, cmdbuf, queue);
+    uint64_t elapsed = etna_time_ns() - start;
+    ctx->stats.commits += 1;
+    ctx->stats.commit_ns += elapsed;
+    if(elapsed > ctx->stats.max_commit_ns)
+        ctx->stats.max_commit_ns = elapsed;
     return status;
 }
 
@@ -451,8 +1097,18 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
     int status = ETNA_OK;
     if(ctx == NULL)
         return ETNA_INVALID_ADDR;
-    if(ctx->cur_buf == ETNA_CTX_BUFFER)
-        /* Can never flush while building context buffer */
+    if(ctx->pipe_seg_active)
+    {
+        /* Write out deferred pipes and flush, then continue recording
+         * in the same pipe */
+        if((status = pipe_segments_write(ctx)) == ETNA_OK)
+            status = etna_flush(ctx, fence_out);
+        int rv = pipe_segment_enter(ctx, ctx->record_pipe);
+        return (status != ETNA_OK) ? status : rv;
+    }
+    if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER ||
+       ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+        /* Can never flush while building context buffer or command block, or a fragment */
         return ETNA_INTERNAL_ERROR;
 
     if(fence_out) /* is a fence handle requested? */
@@ -463,6 +1119,7 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
          * fence number.
          */
         pthread_mutex_lock(&ctx->conn->fence_mutex);
+        ctx->fence_locked = true;
         do {
             /*   Get next fence ID */
             if((status = _viv_fence_new(ctx->conn, &fence, &signal)) != VIV_STATUS_OK)
@@ -485,6 +1142,20 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
     }
     /***** Start fence mutex locked */
     /* Make sure to unlock the mutex before returning */
+    if(ctx->chain_link != NULL)
+        chain_close(ctx);
+    /* A commit that carries queued events (such as a fence) is signalled already */
+    if(ctx->cur_buf >= 0 && ctx->queue->count == 0 && flush_limit_reached(ctx) &&
+       bytes_left_after_flush(ctx, ctx->offset) > ctx->flush_policy.max_wasted_bytes)
+    {
+        /* Rather than giving up on the rest of the buffer, make this commit signalled */
+        if((status = etna_queue_signal(ctx->queue, ctx->flush_sig_id, VIV_WHERE_COMMAND)) != ETNA_OK)
+        {
+            fprintf(stderr, "%s: error %i queueing flush signal\n", __func__, status);
+            goto unlock_and_return_status;
+        }
+        ctx->stats.flush_limit_signals += 1;
+    }
     struct _gcsQUEUE *queue_first = _etna_queue_first(ctx->queue);
     gcoCMDBUF cur_buf = (ctx->cur_buf != ETNA_NO_BUFFER) ? ctx->cmdbuf[ctx->cur_buf] : NULL;
 
@@ -494,7 +1165,7 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
         if(queue_first != NULL)
         {
             ctx->flushes = 0;
-            if((status = viv_event_commit(ctx->conn, queue_first)) != 0)
+            if((status = commit_buffer(ctx, NULL, queue_first)) != 0)
             {
 #ifdef DEBUG
                 fprintf(stderr, "Error committing kernel commands\n");
@@ -507,7 +1178,9 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
         goto unlock_and_return_status;
     }
 
+    ETNA_ALIGN(ctx); /* coalesced state writes can leave the offset unaligned */
     cur_buf->offset = ctx->offset*4; /* Copy over current end offset into CMDBUF, for kernel */
+    patch_pending_calls(ctx, ctx->offset);
 #ifdef DEBUG
     fprintf(stderr, "Committing command buffer %i startOffset=%x offset=%x\n", ctx->cur_buf,
             cur_buf->startOffset, ctx->offset*4);
@@ -518,11 +1191,17 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
 #ifdef GCABI_HAS_CONTEXT
     gpu_context_finish_up(ctx);
 #endif
+    uint32_t flush_bytes = ctx->offset*4 - (cur_buf->startOffset + BEGIN_COMMIT_CLEARANCE);
+    ctx->stats.flushes += 1;
+    ctx->stats.flushed_bytes += flush_bytes;
+    if(flush_bytes > ctx->stats.max_flush_bytes)
+        ctx->stats.max_flush_bytes = flush_bytes;
+    ctx->stats.clearance_bytes += BEGIN_COMMIT_CLEARANCE + END_COMMIT_CLEARANCE;
     if(!queue_first)
         ctx->flushes += 1;
     else
         ctx->flushes = 0;
-    if((status = viv_commit(ctx->conn, cur_buf, ctx->ctx, queue_first)) != 0)
+    if((status = commit_buffer(ctx, cur_buf, queue_first)) != 0)
     {
 #ifdef DEBUG
         fprintf(stderr, "Error committing command buffer\n");
@@ -532,16 +1211,59 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
     if(fence_out)
     {
         _viv_fence_mark_pending(ctx->conn, *fence_out);
+        ctx->fence_locked = false;
         pthread_mutex_unlock(&ctx->conn->fence_mutex);
     }
     /***** End fence mutex locked */
-#ifdef GCABI_HAS_CONTEXT
-    /* set context entryPipe to currentPipe (next commit will start with current pipe) */
-    GCCTX(ctx)->entryPipe = GCCTX(ctx)->currentPipe;
-    gpu_context_clear(ctx);
-    if(ctx->ctx_cb)
+    /* The GPU may still be busy with this commit when the next one starts,
+     * and other clients may use the caches in between */
+    etna_mark_units_busy(ctx, ETNA_UNITS_ALL);
+    if(ctx->shadow)
     {
-        enum etna_pipe initial_pipe, final_pipe;
+        /* Other clients may change GPU state before our next commit */
+        memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+    }
+    cur_buf->startOffset = cur_buf->offset + END_COMMIT_CLEARANCE;
+    cur_buf->offset = cur_buf->startOffset + BEGIN_COMMIT_CLEARANCE;
+
+    if((cur_buf->offset + END_COMMIT_CLEARANCE) >= ctx->buffer_size ||
+       (ctx->flush_policy.max_unsignaled_flushes &&
+        ctx->flushes > ctx->flush_policy.max_unsignaled_flushes))
+    {
+        if((cur_buf->offset + END_COMMIT_CLEARANCE) < ctx->buffer_size)
+        {
+            uint32_t wasted = ctx->buffer_size - END_COMMIT_CLEARANCE - cur_buf->offset;
+            ctx->stats.flush_limit_hits += 1;
+            ctx->stats.flush_limit_wasted_bytes += wasted;
+            ctx->stats.wasted_bytes += wasted;
+        }
+        /* nothing more fits in buffer, prevent warning about buffer overflow
+           on next etna_reserve.
+         */
+        cur_buf->startOffset = cur_buf->offset = ctx->buffer_size - END_COMMIT_CLEARANCE;
+    }
+
+    /* Set writing offset for next etna_reserve. For convenience this is
+       stored as an index instead of a byte offset.  */
+    ctx->offset = cur_buf->offset / 4;
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+    /* Segments can be reused once the GPU is done with this buffer */
+    for(int x=0; x<ctx->chain_bos.num; ++x)
+    {
+        if(bo_list_push(&ctx->cmdbufi[ctx->cur_buf].chain_bos, ctx->chain_bos.bos[x]) != ETNA_OK)
+            etna_bo_del(ctx->conn, ctx->chain_bos.bos[x], ctx->queue);
+    }
+    ctx->chain_bos.num = 0;
+#ifdef GCABI_HAS_CONTEXT
+    /* Build the context for the next commit only now that this commit's
+     * bookkeeping is done, so that a failure can't get it submitted twice */
+    /* set context entryPipe to currentPipe (next commit will start with current pipe) */
+    GCCTX(ctx)->entryPipe = GCCTX(ctx)->currentPipe;
+    gpu_context_clear(ctx);
+    if(ctx->ctx_cb)
+    {
+        enum etna_pipe initial_pipe, final_pipe;
         /* Start building GPU context */
         if((status = gpu_context_build_start(ctx)) != ETNA_OK)
         {
@@ -561,23 +1283,14 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
             fprintf(stderr, "%s: gpu_context_build_end failed with status %i\n", __func__, status);
             return status;
         }
-    }
-#endif
-    cur_buf->startOffset = cur_buf->offset + END_COMMIT_CLEARANCE;
-    cur_buf->offset = cur_buf->startOffset + BEGIN_COMMIT_CLEARANCE;
-
-    if((cur_buf->offset + END_COMMIT_CLEARANCE) >= COMMAND_BUFFER_SIZE ||
-       ctx->flushes > ETNA_MAX_UNSIGNALED_FLUSHES)
+    } else if(ctx->tracker)
     {
-        /* nothing more fits in buffer, prevent warning about buffer overflow
-           on next etna_reserve.
-         */
-        cur_buf->startOffset = cur_buf->offset = COMMAND_BUFFER_SIZE - END_COMMIT_CLEARANCE;
+        /* The commit went through; an empty context only matters if another
+         * client uses the GPU before our next commit */
+        if((status = tracker_build_context(ctx)) != ETNA_OK)
+            fprintf(stderr, "%s: Building context from tracked state failed with status %i\n", __func__, status);
     }
-
-    /* Set writing offset for next etna_reserve. For convenience this is
-       stored as an index instead of a byte offset.  */
-    ctx->offset = cur_buf->offset / 4;
+#endif
 #ifdef DEBUG
 #ifdef GCABI_HAS_CONTEXT
     fprintf(stderr, "  New start offset: %x New offset: %x Contextbuffer used: %i\n", cur_buf->startOffset, cur_buf->offset, *(GCCTX(ctx)->inUse));
@@ -589,10 +1302,38 @@ int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out)
 
 unlock_and_return_status: /* Unlock fence mutex (if necessary) and return status */
     if(fence_out)
+    {
+        ctx->fence_locked = false;
         pthread_mutex_unlock(&ctx->conn->fence_mutex);
+    }
     return status;
 }
 
+int etna_try_flush(struct etna_ctx *ctx, uint32_t *fence_out)
+{
+    int next_buf_id;
+    int status;
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf >= 0)
+    {
+        /* After this commit, etna_flush leaves the rest of the buffer unused
+         * if it is (nearly) full or too many commits went unsignalled; the next
+         * reserve must then switch buffers. */
+        uint32_t offset = (ctx->chain_link != NULL) ? ctx->chain_return : ctx->offset;
+        uint32_t left = bytes_left_after_flush(ctx, offset);
+        if(left == 0 || (flush_limit_reached(ctx) && left <= ctx->flush_policy.max_wasted_bytes))
+        {
+            /* Polling consumed the buffer's signal; keep the buffer for the
+             * next reserve, which would otherwise wait for the signal again */
+            if((status = acquire_next_buffer(ctx, false, &next_buf_id)) != ETNA_OK)
+                return status;
+            ctx->next_buf_acquired = next_buf_id;
+        }
+    }
+    return etna_flush(ctx, fence_out);
+}
+
 int etna_finish(struct etna_ctx *ctx)
 {
     int status;
@@ -609,7 +1350,10 @@ int etna_finish(struct etna_ctx *ctx)
     fprintf(stderr, "finish: Waiting for signal...\n");
 #endif
     /* Wait for signal */
-    if(viv_user_signal_wait(ctx->conn, ctx->sig_id, VIV_WAIT_INDEFINITE) != 0)
+    uint64_t start = etna_time_ns();
+    status = viv_user_signal_wait(ctx->conn, ctx->sig_id, VIV_WAIT_INDEFINITE);
+    ctx->stats.blocked_ns[ETNA_WAIT_FINISH] += etna_time_ns() - start;
+    if(status != 0)
     {
         return ETNA_INTERNAL_ERROR;
     }
@@ -617,21 +1361,48 @@ int etna_finish(struct etna_ctx *ctx)
     return ETNA_OK;
 }
 
+/* Record that a PIPE_SELECT to pipe was emitted into the current buffer */
+static void pipe_selected(struct etna_ctx *ctx, int pipe)
+{
+    if(ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+    {
+        ctx->fragment_pipe = pipe; /* last pipe selected in the fragment */
+        return;
+    }
+    if(ctx->cur_buf != ETNA_CTX_BUFFER && ctx->cur_buf != ETNA_BLOCK_BUFFER)
+    {
+#ifdef GCABI_HAS_CONTEXT
+        GCCTX(ctx)->currentPipe = pipe;
+#endif
+        ctx->cur_pipe = pipe;
+    }
+}
+
 int etna_set_pipe(struct etna_ctx *ctx, enum etna_pipe pipe)
 {
+    uint32_t caches;
     int status;
     if(ctx == NULL)
         return ETNA_INVALID_ADDR;
+    if(ctx->pipe_seg_active)
+    {
+        if(pipe != ETNA_PIPE_2D && pipe != ETNA_PIPE_3D)
+            return ETNA_INVALID_VALUE;
+        ctx->stats.pipe_switches_requested += 1;
+        if(pipe == ctx->record_pipe)
+            return ETNA_OK;
+        pipe_segment_leave(ctx);
+        return pipe_segment_enter(ctx, pipe);
+    }
 
-    if((status = etna_reserve(ctx, 2)) != ETNA_OK)
-        return status;
-    ETNA_EMIT_LOAD_STATE(ctx, VIVS_GL_FLUSH_CACHE>>2, 1, 0);
     switch(pipe)
     {
-    case ETNA_PIPE_2D: ETNA_EMIT(ctx, VIVS_GL_FLUSH_CACHE_PE2D); break;
-    case ETNA_PIPE_3D: ETNA_EMIT(ctx, VIVS_GL_FLUSH_CACHE_DEPTH | VIVS_GL_FLUSH_CACHE_COLOR); break;
+    case ETNA_PIPE_2D: caches = VIVS_GL_FLUSH_CACHE_PE2D; break;
+    case ETNA_PIPE_3D: caches = VIVS_GL_FLUSH_CACHE_DEPTH | VIVS_GL_FLUSH_CACHE_COLOR; break;
     default: return ETNA_INVALID_VALUE;
     }
+    if((status = etna_flush_caches(ctx, caches)) != ETNA_OK)
+        return status;
 
     etna_stall(ctx, SYNC_RECIPIENT_FE, SYNC_RECIPIENT_PE);
 
@@ -640,12 +1411,9 @@ int etna_set_pipe(struct etna_ctx *ctx, enum etna_pipe pipe)
     ETNA_EMIT_LOAD_STATE(ctx, VIVS_GL_PIPE_SELECT>>2, 1, 0);
     ETNA_EMIT(ctx, pipe);
 
-#ifdef GCABI_HAS_CONTEXT
-    if(ctx->cur_buf != ETNA_CTX_BUFFER)
-    {
-        GCCTX(ctx)->currentPipe = pipe;
-    }
-#endif
+    pipe_selected(ctx, pipe);
+    if(ctx->cur_buf >= 0)
+        ctx->stats.pipe_switches += 1;
     return ETNA_OK;
 }
 
@@ -661,11 +1429,32 @@ int etna_semaphore(struct etna_ctx *ctx, uint32_t from, uint32_t to)
     return ETNA_OK;
 }
 
+/* Units that have finished all queued work once unit to has, as seen from
+ * the frontend: work reaches PE through RA, and DE directly.
+ */
+static uint32_t units_drained_by(uint32_t to)
+{
+    switch(to)
+    {
+    case SYNC_RECIPIENT_PE: return ETNA_UNITS_3D;
+    case SYNC_RECIPIENT_RA: return ETNA_UNIT(SYNC_RECIPIENT_FE) | ETNA_UNIT(SYNC_RECIPIENT_RA);
+    default: return ETNA_UNIT(SYNC_RECIPIENT_FE) | ETNA_UNIT(to);
+    }
+}
+
 int etna_stall(struct etna_ctx *ctx, uint32_t from, uint32_t to)
 {
     int status;
     if(ctx == NULL)
         return ETNA_INVALID_ADDR;
+    /* Only stalls in the command buffer itself are tracked; blocks and
+     * fragments run at a point unknown while recording them */
+    bool tracked = ctx->cur_buf > ETNA_CTX_BUFFER && to < 32;
+    if(tracked && ctx->elide_stalls && !(ctx->busy_units & ETNA_UNIT(to)))
+    {
+        ctx->stats.stalls_elided += 1;
+        return ETNA_OK;
+    }
     if((status = etna_reserve(ctx, 4)) != ETNA_OK)
         return status;
     ETNA_EMIT_LOAD_STATE(ctx, VIVS_GL_SEMAPHORE_TOKEN>>2, 1, 0);
@@ -679,9 +1468,498 @@ int etna_stall(struct etna_ctx *ctx, uint32_t from, uint32_t to)
         ETNA_EMIT_LOAD_STATE(ctx, VIVS_GL_STALL_TOKEN>>2, 1, 0);
         ETNA_EMIT(ctx, VIVS_GL_STALL_TOKEN_FROM(from) | VIVS_GL_STALL_TOKEN_TO(to));
     }
+    if(tracked)
+    {
+        ctx->stats.stalls += 1;
+        /* a stall of another unit doesn't hold up the frontend, which may
+         * still queue work before it */
+        if(from == SYNC_RECIPIENT_FE)
+            ctx->busy_units &= ~units_drained_by(to);
+    }
+    return ETNA_OK;
+}
+
+int etna_set_stall_elision(struct etna_ctx *ctx, bool enable)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    ctx->elide_stalls = enable;
+    ctx->busy_units = ETNA_UNITS_ALL;
+    return ETNA_OK;
+}
+
+/* Caches that units may have left dirty: the PE caches by the pipe they
+ * belong to, read caches by any write to memory.
+ */
+static uint32_t caches_dirtied_by(uint32_t units)
+{
+    const uint32_t read_caches = VIVS_GL_FLUSH_CACHE_TEXTURE | VIVS_GL_FLUSH_CACHE_TEXTUREVS |
+        VIVS_GL_FLUSH_CACHE_SHADER_L1 | VIVS_GL_FLUSH_CACHE_SHADER_L2;
+    uint32_t caches = 0;
+    if(units & ~(ETNA_UNITS_3D | ETNA_UNITS_2D))
+        return ETNA_CACHES_ALL;
+    if(units & (ETNA_UNIT(SYNC_RECIPIENT_RA) | ETNA_UNIT(SYNC_RECIPIENT_PE)))
+        caches |= VIVS_GL_FLUSH_CACHE_DEPTH | VIVS_GL_FLUSH_CACHE_COLOR | read_caches;
+    if(units & ETNA_UNIT(SYNC_RECIPIENT_DE))
+        caches |= VIVS_GL_FLUSH_CACHE_PE2D | read_caches;
+    return caches;
+}
+
+int etna_flush_caches(struct etna_ctx *ctx, uint32_t caches)
+{
+    int status;
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    /* As for stalls, only flushes in the command buffer itself are tracked */
+    bool tracked = ctx->cur_buf > ETNA_CTX_BUFFER;
+    if(tracked)
+    {
+        ctx->dirty_caches |= caches_dirtied_by(ctx->dirty_units);
+        ctx->dirty_units = 0;
+        if(ctx->elide_flushes && !(caches & ctx->dirty_caches))
+        {
+            ctx->stats.cache_flushes_elided += 1;
+            return ETNA_OK;
+        }
+        if(ctx->elide_flushes)
+            caches &= ctx->dirty_caches;
+    }
+    if((status = etna_reserve(ctx, 2)) != ETNA_OK)
+        return status;
+    ETNA_EMIT_LOAD_STATE(ctx, VIVS_GL_FLUSH_CACHE>>2, 1, 0);
+    ETNA_EMIT(ctx, caches);
+    /* a following stall must wait for the flush */
+    ctx->busy_units = ETNA_UNITS_ALL;
+    if(tracked)
+    {
+        ctx->dirty_caches &= ~caches;
+        ctx->stats.cache_flushes += 1;
+    }
+    return ETNA_OK;
+}
+
+int etna_set_flush_elision(struct etna_ctx *ctx, bool enable)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    ctx->elide_flushes = enable;
+    ctx->dirty_caches = ETNA_CACHES_ALL;
+    return ETNA_OK;
+}
+
+/* Emit state writes preceding a draw, joining writes to consecutive addresses.
+ * Needs up to two words per write reserved.
+ */
+static void emit_draw_states(struct etna_ctx *ctx, const struct etna_state_write *states, unsigned num)
+{
+    uint32_t hdr = 0, count = 0, next = 0;
+    for(unsigned x=0; x<num; ++x)
+    {
+        uint32_t address = states[x].address;
+        uint32_t value = states[x].value;
+        etna_track_state(ctx, address, value, false);
+        if(ctx->elide_stalls || ctx->elide_flushes)
+            _etna_mark_busy_states(ctx, address, 1);
+        if(_etna_shadow_hit(ctx, address, value))
+        {
+            /* a write that would have joined the run only costs its value */
+            ctx->stats.shadow_words_saved +=
+                (count != 0 && address == next && count < ETNA_COALESCE_MAX_COUNT) ? 1 : 2;
+            count = 0;
+            continue;
+        }
+        if(count != 0 && address == next && count < ETNA_COALESCE_MAX_COUNT)
+        {
+            ++count;
+            ctx->buf[hdr] = (ctx->buf[hdr] & ~VIV_FE_LOAD_STATE_HEADER_COUNT__MASK) |
+                VIV_FE_LOAD_STATE_HEADER_COUNT(count);
+        } else {
+            ETNA_ALIGN(ctx);
+            hdr = ctx->offset;
+            count = 1;
+            ETNA_EMIT_LOAD_STATE(ctx, address >> 2, 1, 0);
+        }
+        ETNA_EMIT(ctx, value);
+        next = address + 4;
+    }
+    ETNA_ALIGN(ctx);
+}
+
+static int draw_multi(struct etna_ctx *ctx, uint32_t primitive_type, const struct etna_draw *draws, unsigned num, bool indexed)
+{
+    const uint32_t draw_words = indexed ? 6 : 4;
+    int status;
+    if(ctx == NULL || (draws == NULL && num != 0))
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf == ETNA_CTX_BUFFER)
+        return ETNA_INTERNAL_ERROR;
+    etna_mark_units_busy(ctx, ETNA_UNITS_3D);
+    unsigned x = 0;
+    while(x < num)
+    {
+        /* Gather as many draws as fit in the current buffer, at least one */
+        size_t avail = 0;
+        size_t words = 0;
+        unsigned end = x;
+        if(ctx->cur_buf != ETNA_NO_BUFFER)
+        {
+            ETNA_ALIGN(ctx);
+            if((ctx->offset*4 + END_COMMIT_CLEARANCE) < ctx->buffer_size)
+                avail = (ctx->buffer_size - END_COMMIT_CLEARANCE)/4 - ctx->offset;
+        }
+        while(end < num)
+        {
+            size_t w = draws[end].num_states*2 + draw_words;
+            if(end > x && (words + w) > avail)
+                break;
+            words += w;
+            ++end;
+        }
+        if((status = etna_reserve(ctx, words)) != ETNA_OK)
+            return status;
+        for(; x<end; ++x)
+        {
+            const struct etna_draw *draw = &draws[x];
+            if(draw->num_states)
+                emit_draw_states(ctx, draw->states, draw->num_states);
+            if(etna_combine_draw(ctx, primitive_type, draw->start, draw->count, indexed, draw->offset))
+                continue;
+            uint32_t hdr = ctx->offset;
+            if(indexed)
+                ETNA_EMIT_DRAW_INDEXED_PRIMITIVES(ctx, primitive_type, draw->start, draw->count, draw->offset);
+            else
+                ETNA_EMIT_DRAW_PRIMITIVES(ctx, primitive_type, draw->start, draw->count);
+            etna_record_draw(ctx, hdr);
+        }
+    }
     return ETNA_OK;
 }
 
+int etna_draw_primitives_multi(struct etna_ctx *ctx, uint32_t primitive_type, const struct etna_draw *draws, unsigned num)
+{
+    return draw_multi(ctx, primitive_type, draws, num, false);
+}
+
+int etna_draw_indexed_primitives_multi(struct etna_ctx *ctx, uint32_t primitive_type, const struct etna_draw *draws, unsigned num)
+{
+    return draw_multi(ctx, primitive_type, draws, num, true);
+}
+
+uint32_t etna_cmd_words(const uint32_t *cmd)
+{
+    uint32_t hdr = cmd[0];
+    uint32_t words;
+    switch(hdr & VIV_FE_LOAD_STATE_HEADER_OP__MASK)
+    {
+    case VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE:
+        words = 1 + etna_load_state_count(hdr);
+        break;
+    case VIV_FE_DRAW_2D_HEADER_OP_DRAW_2D:
+        words = 2 + 2 * ((hdr & VIV_FE_DRAW_2D_HEADER_COUNT__MASK) >> VIV_FE_DRAW_2D_HEADER_COUNT__SHIFT) +
+                ((hdr & VIV_FE_DRAW_2D_HEADER_DATA_COUNT__MASK) >> VIV_FE_DRAW_2D_HEADER_DATA_COUNT__SHIFT);
+        break;
+    case VIV_FE_DRAW_PRIMITIVES_HEADER_OP_DRAW_PRIMITIVES: words = 4; break;
+    case VIV_FE_DRAW_INDEXED_PRIMITIVES_HEADER_OP_DRAW_INDEXED_PRIMITIVES: words = 6; break;
+    case VIV_FE_CALL_HEADER_OP_CALL: words = 4; break;
+    default: words = 2; break; /* END, NOP, WAIT, LINK, STALL, RETURN, CHIP_SELECT */
+    }
+    return (words + 1) & ~1;
+}
+
+int etna_fragment_create(struct etna_ctx *ctx, struct etna_ctx **frag_out)
+{
+    if(ctx == NULL || frag_out == NULL)
+        return ETNA_INVALID_ADDR;
+    struct etna_ctx *frag = ETNA_CALLOC_STRUCT(etna_ctx);
+    if(frag == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    frag->conn = ctx->conn;
+    frag->buffer_size = MIN_COMMAND_BUFFER_SIZE;
+    if((frag->buf = ETNA_MALLOC(frag->buffer_size)) == NULL)
+    {
+        ETNA_FREE(frag);
+        return ETNA_OUT_OF_MEMORY;
+    }
+    frag->cur_buf = ETNA_FRAGMENT_BUFFER;
+    frag->stored_buf = ETNA_NO_BUFFER;
+    frag->fragment_pipe = -1;
+    frag->combine_draws = ctx->combine_draws;
+    *frag_out = frag;
+    return ETNA_OK;
+}
+
+int etna_fragment_reset(struct etna_ctx *frag)
+{
+    if(frag == NULL)
+        return ETNA_INVALID_ADDR;
+    if(frag->cur_buf != ETNA_FRAGMENT_BUFFER)
+        return ETNA_INVALID_VALUE;
+    frag->offset = 0;
+    frag->fragment_pipe = -1;
+    frag->coalesce_buf = NULL;
+    frag->draw_buf = NULL;
+    return ETNA_OK;
+}
+
+int etna_fragment_free(struct etna_ctx *frag)
+{
+    if(frag == NULL)
+        return ETNA_INVALID_ADDR;
+    if(frag->cur_buf != ETNA_FRAGMENT_BUFFER)
+        return ETNA_INVALID_VALUE;
+    ETNA_FREE(frag->buf);
+    ETNA_FREE(frag);
+    return ETNA_OK;
+}
+
+/* Copy whole commands into the ring, switching buffers only at command
+ * boundaries, and feed any state loads to the tracker. Pipe selects are
+ * applied as they are passed, so later loads are tracked for the right pipe.
+ */
+static int append_words(struct etna_ctx *ctx, const uint32_t *words, uint32_t count)
+{
+    uint32_t pos = 0;
+    bool reserved = false; /* reserved for the command at pos already */
+    int status;
+    while(pos < count)
+    {
+        size_t avail = 0;
+        uint32_t end = pos;
+        if(ctx->cur_buf != ETNA_NO_BUFFER)
+        {
+            ETNA_ALIGN(ctx);
+            if((ctx->offset*4 + END_COMMIT_CLEARANCE) < ctx->buffer_size)
+                avail = (ctx->buffer_size - END_COMMIT_CLEARANCE)/4 - ctx->offset;
+        }
+        while(end < count)
+        {
+            const uint32_t *cmd = &words[end];
+            uint32_t n = etna_cmd_words(cmd);
+            if((end + n - pos) > avail)
+                break;
+            if((cmd[0] & VIV_FE_LOAD_STATE_HEADER_OP__MASK) == VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE)
+            {
+                uint32_t base = cmd[0] & VIV_FE_LOAD_STATE_HEADER_OFFSET__MASK;
+                uint32_t num = etna_load_state_count(cmd[0]);
+                if(ctx->tracker)
+                    _etna_track_states(ctx, base << 2, num,
+                            &cmd[1], (cmd[0] & VIV_FE_LOAD_STATE_HEADER_FIXP) != 0);
+                if((VIVS_GL_PIPE_SELECT>>2) >= base && (VIVS_GL_PIPE_SELECT>>2) < base + num)
+                    pipe_selected(ctx, cmd[1 + (VIVS_GL_PIPE_SELECT>>2) - base]);
+            }
+            end += n;
+        }
+        if(end == pos)
+        {
+            /* next command doesn't fit, move on to a new buffer; if it
+             * didn't fit after that either, it is larger than a buffer */
+            if(reserved)
+                return ETNA_OUT_OF_MEMORY;
+            if((status = etna_reserve(ctx, etna_cmd_words(&words[pos]))) != ETNA_OK)
+                return status;
+            reserved = true;
+            continue;
+        }
+        memcpy(&ctx->buf[ctx->offset], &words[pos], (end - pos)*4);
+        ctx->offset += end - pos;
+        pos = end;
+        reserved = false;
+    }
+    return ETNA_OK;
+}
+
+/* Copy fragment into command buffer, splitting it between commands where
+ * it doesn't fit. State loads are recorded in the state tracker. */
+static int append_fragment(struct etna_ctx *ctx, const struct etna_ctx *frag)
+{
+    return append_words(ctx, frag->buf, frag->offset);
+}
+
+/* Write the deferred pipe segments to the command buffer, starting with the
+ * current pipe, and leave segment recording. */
+static int pipe_segments_write(struct etna_ctx *ctx)
+{
+    int first = (ctx->cur_pipe >= 0) ? ctx->cur_pipe : ctx->record_pipe;
+    int status;
+    pipe_segment_leave(ctx);
+    for(int x=0; x<ETNA_NUM_PIPES; ++x)
+    {
+        int pipe = (x == 0) ? first : !first;
+        struct etna_pipe_segment *seg = &ctx->pipe_seg[pipe];
+        if(seg->offset == 0)
+            continue;
+        if(ctx->cur_pipe != pipe && (status = etna_set_pipe(ctx, pipe)) != ETNA_OK)
+            return status;
+        if((status = append_words(ctx, seg->buf, seg->offset)) != ETNA_OK)
+            return status;
+        seg->offset = 0;
+    }
+    etna_mark_units_busy(ctx, ETNA_UNITS_ALL);
+    if(ctx->shadow)
+        memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+    return ETNA_OK;
+}
+
+int etna_set_pipe_deferral(struct etna_ctx *ctx, bool enable)
+{
+    int status;
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(enable == ctx->defer_pipes)
+        return ETNA_OK;
+    if(enable)
+    {
+        if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER ||
+           ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+            return ETNA_INTERNAL_ERROR;
+        if((status = pipe_segment_enter(ctx, (ctx->cur_pipe >= 0) ? ctx->cur_pipe : ETNA_PIPE_3D)) != ETNA_OK)
+            return status;
+        ctx->defer_pipes = true;
+        return ETNA_OK;
+    }
+    if(ctx->pipe_seg_active && (status = pipe_segments_write(ctx)) != ETNA_OK)
+    {
+        pipe_segment_enter(ctx, ctx->record_pipe);
+        return status;
+    }
+    ctx->defer_pipes = false;
+    for(int x=0; x<ETNA_NUM_PIPES; ++x)
+    {
+        ETNA_FREE(ctx->pipe_seg[x].buf);
+        ctx->pipe_seg[x].buf = NULL;
+    }
+    return ETNA_OK;
+}
+
+int etna_pipe_barrier(struct etna_ctx *ctx)
+{
+    int status;
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(!ctx->pipe_seg_active)
+        return ETNA_OK;
+    status = pipe_segments_write(ctx);
+    int rv = pipe_segment_enter(ctx, ctx->record_pipe);
+    return (status != ETNA_OK) ? status : rv;
+}
+
+int etna_ctx_append_fragments(struct etna_ctx *ctx, struct etna_ctx *const *frags, unsigned num)
+{
+    int status = ETNA_OK;
+    if(ctx == NULL || (frags == NULL && num != 0))
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER ||
+       ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+        return ETNA_INTERNAL_ERROR;
+    for(unsigned x=0; x<num && status == ETNA_OK; ++x)
+    {
+        if(frags[x] == NULL || frags[x]->cur_buf != ETNA_FRAGMENT_BUFFER)
+            return ETNA_INVALID_VALUE;
+        status = append_fragment(ctx, frags[x]);
+    }
+    /* The fragments may have changed any state, and queued any work */
+    if(ctx->shadow)
+        memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+    etna_mark_units_busy(ctx, ETNA_UNITS_ALL);
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+    return status;
+}
+
+/* Replay backend: copy the words of every captured commit into the ring and flush */
+/* Refuse commits with LINK or CALL commands: their addresses point into
+ * buffers of the capturing process, which replay does not recreate */
+static int replay_check_commit(void *data, uint64_t timestamp, const struct viv_capture_commit *commit, const uint32_t *words)
+{
+    /* the clearance is skipped on replay, see replay_commit */
+    uint32_t skip = (commit->count < BEGIN_COMMIT_CLEARANCE/4) ? commit->count : BEGIN_COMMIT_CLEARANCE/4;
+    (void)data;
+    (void)timestamp;
+    for(uint32_t pos = skip; pos < commit->count; pos += etna_cmd_words(&words[pos]))
+    {
+        switch(words[pos] & VIV_FE_LOAD_STATE_HEADER_OP__MASK)
+        {
+        case VIV_FE_LINK_HEADER_OP_LINK:
+        case VIV_FE_CALL_HEADER_OP_CALL:
+#ifdef DEBUG
+            fprintf(stderr, "%s: can't replay LINK or CALL at word %u\n", __func__, pos);
+#endif
+            return ETNA_INVALID_VALUE;
+        }
+    }
+    return ETNA_OK;
+}
+
+struct replay_state {
+    struct etna_ctx *ctx;
+    int entry_pipe; /* pipe the captured commits start in, -1 if unknown */
+};
+
+/* The context buffer is not replayed, but the commit following it was
+ * written to start in the context's entry pipe */
+static int replay_context(void *data, uint64_t timestamp, const struct viv_capture_context *context, const uint32_t *words)
+{
+    struct replay_state *state = data;
+    (void)timestamp;
+    (void)words;
+    if(context->entry_pipe == ETNA_PIPE_2D || context->entry_pipe == ETNA_PIPE_3D)
+        state->entry_pipe = context->entry_pipe;
+    else
+        state->entry_pipe = -1;
+    return ETNA_OK;
+}
+
+static int replay_commit(void *data, uint64_t timestamp, const struct viv_capture_commit *commit, const uint32_t *words)
+{
+    struct replay_state *state = data;
+    struct etna_ctx *ctx = state->ctx;
+    /* etna reserves its own clearance at the start of every commit */
+    uint32_t skip = (commit->count < BEGIN_COMMIT_CLEARANCE/4) ? commit->count : BEGIN_COMMIT_CLEARANCE/4;
+    int status;
+    (void)timestamp;
+    if(state->entry_pipe != -1 && ctx->cur_pipe != state->entry_pipe &&
+       (status = etna_set_pipe(ctx, state->entry_pipe)) != ETNA_OK)
+        return status;
+    /* pipe selects in the stream update cur_pipe as they are copied */
+    if((status = append_words(ctx, &words[skip], commit->count - skip)) != ETNA_OK)
+        return status;
+    /* The replayed stream may have changed any state */
+    if(ctx->shadow)
+        memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+    ctx->coalesce_buf = NULL;
+    ctx->draw_buf = NULL;
+    return etna_flush(ctx, NULL);
+}
+
+int etna_replay(struct etna_ctx *ctx, const char *path)
+{
+    if(ctx == NULL || path == NULL)
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER ||
+       ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+        return ETNA_INTERNAL_ERROR;
+    /* Context buffers are rebuilt by etna itself, and captured events refer
+     * to signals and memory of the capturing process, so only commits are replayed.
+     */
+    struct viv_replay_backend check = {
+        .commit = replay_check_commit,
+        .data = ctx
+    };
+    struct replay_state state = {
+        .ctx = ctx,
+        .entry_pipe = -1
+    };
+    struct viv_replay_backend backend = {
+        .commit = replay_commit,
+        .context = replay_context,
+        .data = &state
+    };
+    int status;
+    if((status = viv_replay(path, &check)) != VIV_STATUS_OK)
+        return status;
+    return viv_replay(path, &backend);
+}
+
 int etna_set_context_cb(struct etna_ctx *ctx, etna_context_snapshot_cb_t snapshot_cb, void *data)
 {
     ctx->ctx_cb = snapshot_cb;
@@ -689,6 +1967,288 @@ int etna_set_context_cb(struct etna_ctx *ctx, etna_context_snapshot_cb_t snapsho
     return ETNA_OK;
 }
 
+int etna_set_async(struct etna_ctx *ctx, bool enable)
+{
+    int rv;
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(enable && (rv = viv_async_start(ctx->conn)) != VIV_STATUS_OK)
+        return rv;
+    if(!enable && ctx->async)
+    {
+        uint64_t start = etna_time_ns();
+        rv = viv_async_drain(ctx->conn);
+        ctx->stats.blocked_ns[ETNA_WAIT_ASYNC_DRAIN] += etna_time_ns() - start;
+        if(rv != VIV_STATUS_OK)
+            return rv;
+    }
+    ctx->async = enable;
+    return ETNA_OK;
+}
+
+int etna_get_stats(struct etna_ctx *ctx, struct etna_stats *stats)
+{
+    if(ctx == NULL || stats == NULL)
+        return ETNA_INVALID_ADDR;
+    *stats = ctx->stats;
+    stats->ctx_pool_buffers = ctx->ctx_pool_count;
+    return ETNA_OK;
+}
+
+int etna_reset_stats(struct etna_ctx *ctx)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    return ETNA_OK;
+}
+
+void etna_get_default_flush_policy(struct viv_conn *conn, struct etna_flush_policy *policy)
+{
+    policy->max_unsignaled_flushes = ETNA_MAX_UNSIGNALED_FLUSHES;
+    if(conn == NULL || conn->kernel_driver.major < 4)
+        /* Old kernels: always move to the next buffer, as before */
+        policy->max_wasted_bytes = UINT32_MAX;
+    else
+        policy->max_wasted_bytes = ETNA_DEFAULT_MAX_WASTED_BYTES;
+}
+
+int etna_set_flush_policy(struct etna_ctx *ctx, const struct etna_flush_policy *policy)
+{
+    if(ctx == NULL || policy == NULL)
+        return ETNA_INVALID_ADDR;
+    ctx->flush_policy = *policy;
+    return ETNA_OK;
+}
+
+int etna_set_draw_combining(struct etna_ctx *ctx, bool enable)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    ctx->combine_draws = enable;
+    ctx->draw_buf = NULL;
+    return ETNA_OK;
+}
+
+int etna_set_chaining(struct etna_ctx *ctx, bool enable)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    /* prefetch of a LINK into a full segment must fit */
+    if(enable && (ctx->buffer_size / 8) > VIV_FE_LINK_HEADER_PREFETCH__MASK)
+        return ETNA_INVALID_VALUE;
+    ctx->chain = enable;
+    return ETNA_OK;
+}
+
+int etna_cmdblock_begin(struct etna_ctx *ctx)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER ||
+       ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+        return ETNA_INTERNAL_ERROR;
+    if(ctx->block_buf == NULL &&
+       (ctx->block_buf = ETNA_MALLOC(ctx->buffer_size)) == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    /* Save current buffer id and position (which can be in a chained segment) */
+    ctx->stored_buf = ctx->cur_buf;
+    ctx->stored_ptr = ctx->buf;
+    ctx->stored_offset = ctx->offset;
+
+    /* Switch to block staging buffer */
+    ctx->cur_buf = ETNA_BLOCK_BUFFER;
+    ctx->buf = ctx->block_buf;
+    ctx->offset = 0;
+    ctx->draw_buf = NULL;
+    return ETNA_OK;
+}
+
+int etna_cmdblock_end(struct etna_ctx *ctx, struct etna_cmdblock **block_out)
+{
+    int rv = ETNA_OK;
+    if(ctx == NULL || block_out == NULL)
+        return ETNA_INVALID_ADDR;
+    if(ctx->cur_buf != ETNA_BLOCK_BUFFER)
+        return ETNA_INTERNAL_ERROR;
+    /* Return to caller; RETURN is padded to 64 bit like other commands */
+    if((rv = etna_reserve(ctx, 2)) != ETNA_OK)
+        return rv;
+    ETNA_EMIT(ctx, VIV_FE_RETURN_HEADER_OP_RETURN);
+    ETNA_EMIT(ctx, VIV_FE_NOP_HEADER_OP_NOP);
+
+    struct etna_cmdblock *block = ETNA_CALLOC_STRUCT(etna_cmdblock);
+    if(block == NULL)
+    {
+        rv = ETNA_OUT_OF_MEMORY;
+        goto switch_back;
+    }
+    block->bytes = ctx->offset * 4;
+    if((block->bo = etna_bo_new(ctx->conn, block->bytes, DRM_ETNA_GEM_TYPE_CMD)) == NULL)
+    {
+        ETNA_FREE(block);
+        rv = ETNA_OUT_OF_MEMORY;
+        goto switch_back;
+    }
+    memcpy(etna_bo_map(block->bo), ctx->block_buf, block->bytes);
+    *block_out = block;
+
+switch_back: /* Switch back to stored buffer */
+    ctx->cur_buf = ctx->stored_buf;
+    ctx->buf = ctx->stored_ptr;
+    ctx->offset = ctx->stored_offset;
+    ctx->draw_buf = NULL;
+    return rv;
+}
+
+int etna_cmdblock_call(struct etna_ctx *ctx, const struct etna_cmdblock *block)
+{
+    int status;
+    if(ctx == NULL || block == NULL)
+        return ETNA_INVALID_ADDR;
+    /* return address of CALL is absolute, so it can't be in a fragment */
+    if(ctx->cur_buf == ETNA_CTX_BUFFER || ctx->cur_buf == ETNA_BLOCK_BUFFER ||
+       ctx->cur_buf == ETNA_FRAGMENT_BUFFER)
+        return ETNA_INTERNAL_ERROR;
+    if(ctx->num_pending_calls == ETNA_MAX_PENDING_CALLS &&
+       (status = etna_flush(ctx, NULL)) != ETNA_OK)
+        return status;
+    if((status = etna_reserve(ctx, 4)) != ETNA_OK)
+        return status;
+    struct etna_bo *cur_bo = (ctx->chain_link != NULL) ? ctx->chain_bos.bos[ctx->chain_bos.num - 1] :
+                                                         ctx->cmdbufi[ctx->cur_buf].bo;
+    uint32_t return_address = etna_bo_gpu_address(cur_bo) + (ctx->offset + 4) * 4;
+    ctx->pending_calls[ctx->num_pending_calls++] = ctx->offset;
+    ETNA_EMIT(ctx, VIV_FE_CALL_HEADER_OP_CALL | VIV_FE_CALL_HEADER_PREFETCH(block->bytes / 8));
+    ETNA_EMIT(ctx, etna_bo_gpu_address(block->bo));
+    ETNA_EMIT(ctx, 0); /* return prefetch, filled in by etna_flush */
+    ETNA_EMIT(ctx, return_address);
+    /* The block may have changed any state, and queued any work */
+    if(ctx->shadow)
+        memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+    etna_mark_units_busy(ctx, ETNA_UNITS_ALL);
+    return ETNA_OK;
+}
+
+int etna_cmdblock_free(struct etna_ctx *ctx, struct etna_cmdblock *block)
+{
+    int rv;
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(block == NULL)
+        return ETNA_OK;
+    rv = etna_bo_del(ctx->conn, block->bo, ctx->queue);
+    ETNA_FREE(block);
+    return rv;
+}
+
+int etna_set_shadow(struct etna_ctx *ctx, bool enable)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(!enable)
+    {
+        ETNA_FREE(ctx->shadow);
+        ctx->shadow = NULL;
+        return ETNA_OK;
+    }
+    if(ctx->shadow != NULL)
+        return ETNA_OK;
+    struct etna_shadow *shadow = ETNA_CALLOC_STRUCT(etna_shadow);
+    if(shadow == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    init_state_mask(shadow->cacheable);
+    ctx->shadow = shadow;
+    return ETNA_OK;
+}
+
+int etna_set_state_tracking(struct etna_ctx *ctx, bool enable)
+{
+    if(ctx == NULL)
+        return ETNA_INVALID_ADDR;
+    if(!enable)
+    {
+        if(ctx->tracker)
+            free(ctx->tracker->image);
+        ETNA_FREE(ctx->tracker);
+        ctx->tracker = NULL;
+        return ETNA_OK;
+    }
+    if(ctx->tracker != NULL)
+        return ETNA_OK;
+    struct etna_state_tracker *tracker = ETNA_CALLOC_STRUCT(etna_state_tracker);
+    if(tracker == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    init_state_mask(tracker->trackable);
+    ctx->tracker = tracker;
+    return ETNA_OK;
+}
+
+void _etna_track_states(struct etna_ctx *ctx, uint32_t base, uint32_t num, const uint32_t *values, bool fixp)
+{
+    uint32_t first = base >> 2;
+    if((first + num) > ETNA_NUM_STATES)
+        return;
+    for(uint32_t i = 0; i < num; ++i)
+        etna_track_state(ctx, (first + i) << 2, values[i], fixp);
+}
+
+void _etna_mark_busy_states(struct etna_ctx *ctx, uint32_t base, uint32_t num)
+{
+    for(unsigned x=0; x<sizeof(etna_trigger_states)/sizeof(etna_trigger_states[0]); ++x)
+    {
+        if(etna_trigger_states[x] >= base && etna_trigger_states[x] < base + num*4)
+        {
+            if(trigger_writes_memory(etna_trigger_states[x]))
+                etna_mark_units_busy(ctx, ETNA_UNITS_ALL);
+            else
+                ctx->busy_units = ETNA_UNITS_ALL;
+            return;
+        }
+    }
+}
+
+void etna_shadow_invalidate(struct etna_ctx *ctx, uint32_t base, uint32_t num)
+{
+    if(ctx == NULL || ctx->shadow == NULL)
+        return;
+    for(uint32_t idx = base >> 2; num > 0 && idx < ETNA_NUM_STATES; ++idx, --num)
+        ctx->shadow->valid[idx >> 5] &= ~(1u << (idx & 31));
+}
+
+bool _etna_shadow_update_multi(struct etna_ctx *ctx, uint32_t *base, uint32_t *num, const uint32_t **values)
+{
+    struct etna_shadow *shadow = ctx->shadow;
+    uint32_t first = *base >> 2;
+    uint32_t lo = 0, hi = *num;
+    if(ctx->cur_buf <= ETNA_CTX_BUFFER || (first + *num) > ETNA_NUM_STATES)
+        return true;
+    /* Find first and last word that differ from the shadow */
+#define SHADOW_MATCH(i) ((shadow->valid[(first+(i)) >> 5] & (1u << ((first+(i)) & 31))) && \
+                         shadow->values[first+(i)] == (*values)[i])
+    while(lo < hi && SHADOW_MATCH(lo))
+        ++lo;
+    while(hi > lo && SHADOW_MATCH(hi - 1))
+        --hi;
+#undef SHADOW_MATCH
+    if(lo == hi)
+    {
+        ctx->stats.shadow_words_saved += *num + 1;
+        return false;
+    }
+    for(uint32_t i = lo; i < hi; ++i)
+    {
+        uint32_t idx = first + i;
+        shadow->values[idx] = (*values)[i];
+        shadow->valid[idx >> 5] |= shadow->cacheable[idx >> 5] & (1u << (idx & 31));
+    }
+    ctx->stats.shadow_words_saved += *num - (hi - lo);
+    *base += lo * 4;
+    *values += lo;
+    *num = hi - lo;
+    return true;
+}
+
 void etna_dump_cmd_buffer(struct etna_ctx *ctx)
 {
     uint32_t start_offset = ctx->cmdbuf[ctx->cur_buf]->startOffset/4 + 8;
@@ -34,22 +34,36 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #ifdef DEBUG
 #include <stdio.h>
 #endif
 #include <string.h> /* for memcpy */
 
-/* Number of command buffers, to be used in a circular fashion.
+/* Default number of command buffers, to be used in a circular fashion.
  */
 #define NUM_COMMAND_BUFFERS 5
 
 /* Special command buffer ids */
 #define ETNA_NO_BUFFER (-1)
 #define ETNA_CTX_BUFFER (-2)
+#define ETNA_BLOCK_BUFFER (-3)
+#define ETNA_FRAGMENT_BUFFER (-4)
 
-/* Number of bytes in one command buffer */
+/* Maximum number of context buffers kept for re-use while the GPU is
+ * still busy with them (v2 kernels only) */
+#define ETNA_CTX_POOL_SIZE 4
+
+/* Maximum number of command block CALLs per commit, their return prefetch
+ * is patched in etna_flush */
+#define ETNA_MAX_PENDING_CALLS 64
+
+/* Default number of bytes in one command buffer */
 #define COMMAND_BUFFER_SIZE (0x8000)
 
+/* Minimum number of bytes in one command buffer */
+#define MIN_COMMAND_BUFFER_SIZE (0x1000)
+
 /* Constraints to command buffer layout:
  *
  * - Keep 8 words (32 bytes) at beginning of commit (for kernel to add optional PIPE switch)
@@ -66,6 +80,16 @@
 #define BEGIN_COMMIT_CLEARANCE 32
 #define END_COMMIT_CLEARANCE 24
 
+/* Maximum number of states in a LOAD_STATE that is extended by run-time
+ * coalescing (COUNT field is 10 bits) */
+#define ETNA_COALESCE_MAX_COUNT (1023)
+
+/* Default for etna_flush_policy.max_wasted_bytes on v4 and newer kernels */
+#define ETNA_DEFAULT_MAX_WASTED_BYTES (0x1000)
+
+/* Number of state words addressable through LOAD_STATE (16 bit word offset) */
+#define ETNA_NUM_STATES (0x10000)
+
 /** Structure definitions */
 
 /* Etna error (return) codes */
@@ -75,7 +99,8 @@ enum etna_status {
     ETNA_INVALID_VALUE  = 1001,
     ETNA_OUT_OF_MEMORY  = 1002,
     ETNA_INTERNAL_ERROR = 1003,
-    ETNA_ALREADY_LOCKED = 1004
+    ETNA_ALREADY_LOCKED = 1004,
+    ETNA_WOULD_BLOCK    = 1005  /* next command buffer is still in use by the GPU */
 };
 
 /* HW pipes.
@@ -85,12 +110,107 @@ enum etna_pipe {
     ETNA_PIPE_3D = 0,
     ETNA_PIPE_2D = 1
 };
+#define ETNA_NUM_PIPES 2
+
+/* Masks of GPU units, for etna_mark_units_busy. unit is a SYNC_RECIPIENT_* value. */
+#define ETNA_UNIT(unit) (1u << (unit))
+#define ETNA_UNITS_3D (ETNA_UNIT(SYNC_RECIPIENT_FE) | ETNA_UNIT(SYNC_RECIPIENT_RA) | ETNA_UNIT(SYNC_RECIPIENT_PE))
+#define ETNA_UNITS_2D (ETNA_UNIT(SYNC_RECIPIENT_FE) | ETNA_UNIT(SYNC_RECIPIENT_DE))
+#define ETNA_UNITS_ALL (~0u)
 
 struct _gcoCMDBUF;
 struct etna_queue;
 struct etna_ctx;
 struct etna_bo;
 
+/* Command buffer ring configuration, passed to etna_create_config */
+struct etna_ctx_config {
+    /* Number of command buffers to allocate initially */
+    unsigned num_buffers;
+    /* Number of bytes per command buffer (also used for context buffer) */
+    unsigned buffer_size;
+    /* If larger than num_buffers, add a buffer to the ring when switching
+     * buffers had to wait grow_threshold times, until there are max_buffers */
+    unsigned max_buffers;
+    unsigned grow_threshold;
+};
+
+/* Policy for working around kernels that misbehave when too many commits in a
+ * row have no kernel event (such as a signal) queued, see etna_set_flush_policy.
+ */
+struct etna_flush_policy {
+    /* Maximum number of commits in a row without kernel event, 0 for no limit */
+    unsigned max_unsignaled_flushes;
+    /* When the limit is reached and at most this many bytes are left in the
+     * command buffer, leave them unused and move on to the next buffer (which
+     * queues a signal). Otherwise queue a signal with the commit. */
+    uint32_t max_wasted_bytes;
+};
+
+/* Places where the library blocks, for etna_stats.blocked_ns */
+enum etna_wait_site {
+    ETNA_WAIT_BUFFER_SWITCH, /* waiting for the GPU to release the next command buffer */
+    ETNA_WAIT_FINISH,        /* etna_finish */
+    ETNA_WAIT_ASYNC_DRAIN,   /* waiting for the submission thread */
+    ETNA_NUM_WAIT_SITES
+};
+
+/* Command buffer usage statistics, see etna_get_stats */
+struct etna_stats {
+    /* number of commits of command buffer contents, and their total and
+     * largest size in bytes (excluding chained segments) */
+    uint64_t flushes;
+    uint64_t flushed_bytes;
+    uint32_t max_flush_bytes;
+    /* bytes committed in chained segments */
+    uint64_t chained_bytes;
+    /* bytes reserved for the kernel around commits */
+    uint64_t clearance_bytes;
+    /* bytes left unused at the end of command buffers and segments */
+    uint64_t wasted_bytes;
+    /* number of switches to the next command buffer in the ring */
+    uint64_t buffer_switches;
+    /* number of draws merged into the previous draw command */
+    uint64_t draws_combined;
+    /* number of times the unsignalled flush limit moved on to the next buffer,
+     * the bytes this left unused (included in wasted_bytes), and number of
+     * times a signal was queued instead */
+    uint32_t flush_limit_hits;
+    uint64_t flush_limit_wasted_bytes;
+    uint32_t flush_limit_signals;
+    /* time spent blocking, per wait site */
+    uint64_t blocked_ns[ETNA_NUM_WAIT_SITES];
+    /* number of commits to the kernel (including commits of only kernel
+     * commands), total and largest time taken. In asynchronous mode (see
+     * etna_set_async) this is the time taken to queue the commit for the
+     * submission thread, not to submit it. */
+    uint64_t commits;
+    uint64_t commit_ns;
+    uint64_t max_commit_ns;
+    /* number of pipe switches emitted, and number of switches requested while
+     * deferring pipes (see etna_set_pipe_deferral) */
+    uint64_t pipe_switches;
+    uint64_t pipe_switches_requested;
+    /* number of stalls emitted by etna_stall, and number skipped because the
+     * unit waited for had no work outstanding (see etna_set_stall_elision) */
+    uint64_t stalls;
+    uint64_t stalls_elided;
+    /* number of cache flushes emitted by etna_flush_caches and etna_set_pipe,
+     * and number skipped because none of the caches were dirty (see
+     * etna_set_flush_elision) */
+    uint64_t cache_flushes;
+    uint64_t cache_flushes_elided;
+    /* number of command words not emitted because the register shadow showed
+     * the writes to be redundant (see etna_set_shadow) */
+    uint64_t shadow_words_saved;
+    /* number of times an idle context buffer could be taken from the pool
+     * (hits) or one had to be allocated (misses), and number of context
+     * buffers in the pool (not reset) */
+    uint64_t ctx_pool_hits;
+    uint64_t ctx_pool_misses;
+    uint32_t ctx_pool_buffers;
+};
+
 struct etna_context_info {
     size_t bytes;
     viv_addr_t physical;
@@ -100,10 +220,83 @@ struct etna_context_info {
 typedef int (*etna_context_snapshot_cb_t)(void *data, struct etna_ctx *ctx,
         enum etna_pipe *initial_pipe, enum etna_pipe *final_pipe);
 
+/* Shadow copy of register values written through etna_set_state*, used to
+ * drop writes that would not change anything.
+ */
+struct etna_shadow {
+    /* last value written, per state word */
+    uint32_t values[ETNA_NUM_STATES];
+    /* bitmask of state words for which values[] is known to match the GPU */
+    uint32_t valid[ETNA_NUM_STATES/32];
+    /* bitmask of state words that can be shadowed (excludes trigger registers
+     * such as flushes, semaphores and kickers, which must always be written) */
+    uint32_t cacheable[ETNA_NUM_STATES/32];
+};
+
+/* Register state written through etna_set_state*, used to generate the
+ * context buffer when no context callback is set. Only registers that have
+ * been written are restored, as a CPU-side image of LOAD_STATE commands that is
+ * patched in place on writes and re-laid out only when new registers are touched.
+ */
+struct etna_state_tracker {
+    /* last value written, per state word */
+    uint32_t values[ETNA_NUM_STATES];
+    /* index of the value of each laid out state word in image */
+    uint32_t pos[ETNA_NUM_STATES];
+    /* bitmask of state words that have been written */
+    uint32_t touched[ETNA_NUM_STATES/32];
+    /* bitmask of touched state words last written with FIXP */
+    uint32_t fixp[ETNA_NUM_STATES/32];
+    /* bitmask of touched state words last written in the 2D pipe */
+    uint32_t pipe2d[ETNA_NUM_STATES/32];
+    /* bitmask of state words that can be restored (excludes trigger registers) */
+    uint32_t trackable[ETNA_NUM_STATES/32];
+    /* LOAD_STATE commands restoring touched state, one section per pipe */
+    uint32_t *image;
+    uint32_t image_words;
+    uint32_t pipe_start[ETNA_NUM_PIPES];
+    uint32_t pipe_words[ETNA_NUM_PIPES];
+    uint32_t image_capacity;
+    /* set of touched state words changed since image was laid out */
+    bool layout_dirty;
+};
+
+/* Reusable block of commands, recorded once and executed from the command
+ * stream with a CALL.
+ */
+struct etna_cmdblock {
+    struct etna_bo *bo;
+    /* size in bytes, including the final RETURN */
+    uint32_t bytes;
+};
+
+/* Context buffer that is not current, with location of its inUse flag */
+struct etna_ctx_pool_entry {
+    struct etna_bo *bo;
+    volatile int *in_use;
+};
+
+/* Commands for one pipe recorded while deferring pipe switches */
+struct etna_pipe_segment {
+    uint32_t *buf;
+    uint32_t offset; /* in words */
+    uint32_t size; /* in bytes */
+};
+
+/* Growable array of buffer objects */
+struct etna_bo_list {
+    struct etna_bo **bos;
+    int num;
+    int max;
+};
+
 struct etna_cmdbuf {
     /* sync signal for command buffer */
     int sig_id;
     struct etna_bo *bo;
+    /* chained segments of commits in this buffer, idle once the sync
+     * signal fired */
+    struct etna_bo_list chain_bos;
 };
 
 struct etna_ctx {
@@ -122,21 +315,111 @@ struct etna_ctx {
     int cur_buf;
     /* Stored current buffer id when building context */
     int stored_buf;
+    /* Stored writing location when recording a command block or pipe segment,
+     * or building the context */
+    uint32_t *stored_ptr;
+    uint32_t stored_offset;
+    uint32_t stored_buffer_size;
     /* Synchronization signal for finish() */
     int sig_id;
-    /* Structures for kernel */
-    struct _gcoCMDBUF *cmdbuf[NUM_COMMAND_BUFFERS];
-    /* Extra information per command buffer */
-    struct etna_cmdbuf cmdbufi[NUM_COMMAND_BUFFERS];
+    /* Number of bytes in each command buffer */
+    uint32_t buffer_size;
+    /* Number of command buffers in ring, and maximum it can grow to */
+    int num_buffers;
+    int max_buffers;
+    /* Grow ring after this many buffer switches had to wait */
+    int grow_threshold;
+    int blocked_switches;
+    /* Next buffer, already acquired by etna_try_flush (its signal consumed),
+     * or ETNA_NO_BUFFER */
+    int next_buf_acquired;
+    /* Structures for kernel (max_buffers entries) */
+    struct _gcoCMDBUF **cmdbuf;
+    /* Extra information per command buffer (max_buffers entries) */
+    struct etna_cmdbuf *cmdbufi;
     /* number of unsignalled flushes (used to work around kernel bug) */
     int flushes;
+    struct etna_flush_policy flush_policy;
+    /* signal queued when a commit must not go unsignalled */
+    int flush_sig_id;
     /* context */
     viv_context_t ctx;
     struct etna_bo *ctx_bo;
+    /* context buffers waiting to be re-used */
+    struct etna_ctx_pool_entry ctx_pool[ETNA_CTX_POOL_SIZE];
+    int ctx_pool_count;
     etna_context_snapshot_cb_t ctx_cb;
     void *ctx_cb_data;
     /* command queue */
     struct etna_queue *queue;
+    /* register shadow cache (NULL if disabled) */
+    struct etna_shadow *shadow;
+    /* register state tracker for generating the context (NULL if disabled) */
+    struct etna_state_tracker *tracker;
+    /* Last LOAD_STATE emitted by etna_set_state*, kept open so that a write to
+     * the next register can be appended to it. Only valid while buf equals
+     * coalesce_buf and nothing else was emitted after coalesce_end.
+     */
+    uint32_t *coalesce_buf;
+    uint32_t coalesce_hdr; /* offset of LOAD_STATE header word */
+    uint32_t coalesce_end; /* offset just past last state value */
+    /* Last draw command emitted, kept open so that a following draw of the
+     * adjacent range can be merged into it (if combine_draws is set). Only
+     * valid while buf equals draw_buf and nothing else was emitted after draw_end.
+     */
+    bool combine_draws;
+    uint32_t *draw_buf;
+    uint32_t draw_hdr; /* offset of draw command header */
+    uint32_t draw_end; /* offset just past draw command */
+    /* staging buffer for recording command blocks */
+    uint32_t *block_buf;
+    /* offsets of CALL commands in the current commit, whose return prefetch
+     * must be filled in before submission */
+    uint32_t pending_calls[ETNA_MAX_PENDING_CALLS];
+    int num_pending_calls;
+    /* hand off commits to the connection's submission thread */
+    bool async;
+    /* the thread using this context holds conn->fence_mutex (in a fenced
+     * etna_flush, possibly with a nested flush of a full queue) */
+    bool fence_locked;
+    /* for fragments: last pipe selected, or -1 */
+    int fragment_pipe;
+    struct etna_stats stats;
+    /* continue in a new segment linked to from a full command buffer, instead
+     * of flushing it (see etna_set_chaining) */
+    bool chain;
+    /* segments of the current commit, handed to its command buffer after
+     * it was submitted */
+    struct etna_bo_list chain_bos;
+    /* idle segments, to be reused before allocating new ones */
+    struct etna_bo_list chain_pool;
+    /* offset in command buffer just past the LINK to the first segment,
+     * where the last segment links back to */
+    uint32_t chain_return;
+    /* header of the LINK into the current segment, whose prefetch is filled in
+     * when the segment ends (NULL if not writing to a segment) */
+    uint32_t *chain_link;
+    /* last pipe selected in the command buffer, or -1 if unknown */
+    int cur_pipe;
+    /* record into a segment per pipe, and only write them to the command
+     * buffer at flush or barrier (see etna_set_pipe_deferral) */
+    bool defer_pipes;
+    /* currently writing into pipe_seg[record_pipe] instead of the command buffer */
+    bool pipe_seg_active;
+    int record_pipe;
+    struct etna_pipe_segment pipe_seg[ETNA_NUM_PIPES];
+    /* skip stalls on units without outstanding work (see etna_set_stall_elision) */
+    bool elide_stalls;
+    /* units (ETNA_UNIT(SYNC_RECIPIENT_*)) that may have work queued since
+     * the frontend last stalled on them */
+    uint32_t busy_units;
+    /* skip flushes of caches that are not dirty (see etna_set_flush_elision) */
+    bool elide_flushes;
+    /* units that may have written memory since dirty_caches was last updated */
+    uint32_t dirty_units;
+    /* caches (VIVS_GL_FLUSH_CACHE_*) that may hold data not in, or stale
+     * with respect to, memory */
+    uint32_t dirty_caches;
 };
 
 /** Convenience macros for command buffer building, remember to reserve enough space before using them */
@@ -159,12 +442,12 @@ struct etna_ctx {
       (ctx)->buf[(ctx)->offset++] = count; } while(0)
 
 /* Draw indexed primitives (queues 6 words) */
-#define ETNA_EMIT_DRAW_INDEXED_PRIMITIVES(ctx, cmd, start, count, offset) \
+#define ETNA_EMIT_DRAW_INDEXED_PRIMITIVES(ctx, cmd, start, count, index_offset) \
     do { (ctx)->buf[(ctx)->offset++] = VIV_FE_DRAW_INDEXED_PRIMITIVES_HEADER_OP_DRAW_INDEXED_PRIMITIVES; \
       (ctx)->buf[(ctx)->offset++] = cmd; \
       (ctx)->buf[(ctx)->offset++] = start; \
       (ctx)->buf[(ctx)->offset++] = count; \
-      (ctx)->buf[(ctx)->offset++] = offset; \
+      (ctx)->buf[(ctx)->offset++] = index_offset; \
       (ctx)->offset++; } while(0)
 
 /* Queue a STALL command (queues 2 words) */
@@ -175,6 +458,45 @@ struct etna_ctx {
 /* Round current offset to 64-bit */
 #define ETNA_ALIGN(ctx) ctx->offset = (ctx->offset + 1)&(~1);
 
+/** Emit cursor macros, for writing commands through a local pointer obtained
+ * with etna_begin_emit, instead of through ctx. Same arguments as the
+ * ETNA_EMIT* macros, with cur the cursor. */
+/* Queue load state command header (queues one word) */
+#define ETNA_CURSOR_LOAD_STATE(cur, ofs, count, fixp) \
+    *(cur)++ = \
+    (VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE | ((fixp)?VIV_FE_LOAD_STATE_HEADER_FIXP:0) | \
+     VIV_FE_LOAD_STATE_HEADER_OFFSET(ofs) | \
+     (VIV_FE_LOAD_STATE_HEADER_COUNT(count) & VIV_FE_LOAD_STATE_HEADER_COUNT__MASK))
+
+/* Queues one value (1 word) */
+#define ETNA_CURSOR_EMIT(cur, value) \
+    *(cur)++ = (value)
+
+/* Draw array primitives (queues 4 words) */
+#define ETNA_CURSOR_DRAW_PRIMITIVES(cur, cmd, start, count) \
+    do { *(cur)++ = VIV_FE_DRAW_PRIMITIVES_HEADER_OP_DRAW_PRIMITIVES; \
+      *(cur)++ = cmd; \
+      *(cur)++ = start; \
+      *(cur)++ = count; } while(0)
+
+/* Draw indexed primitives (queues 6 words) */
+#define ETNA_CURSOR_DRAW_INDEXED_PRIMITIVES(cur, cmd, start, count, index_offset) \
+    do { *(cur)++ = VIV_FE_DRAW_INDEXED_PRIMITIVES_HEADER_OP_DRAW_INDEXED_PRIMITIVES; \
+      *(cur)++ = cmd; \
+      *(cur)++ = start; \
+      *(cur)++ = count; \
+      *(cur)++ = index_offset; \
+      (cur)++; } while(0)
+
+/* Queue a STALL command (queues 2 words) */
+#define ETNA_CURSOR_STALL(cur, from, to) \
+    do { *(cur)++ = VIV_FE_STALL_HEADER_OP_STALL; \
+      *(cur)++ = VIV_FE_STALL_TOKEN_FROM(from) | VIV_FE_STALL_TOKEN_TO(to); } while(0)
+
+/* Round cursor to 64-bit (command buffers are at least 64-bit aligned) */
+#define ETNA_CURSOR_ALIGN(cur) \
+    (cur) = (uint32_t *)(((uintptr_t)(cur) + 7) & ~(uintptr_t)7)
+
 /* macro for MASKED() (multiple can be &ed) */
 #define ETNA_MASKED(NAME, VALUE) (~(NAME ## _MASK | NAME ## __MASK) | ((VALUE)<<(NAME ## __SHIFT)))
 /* for boolean bits */
@@ -183,11 +505,21 @@ struct etna_ctx {
  */
 #define ETNA_MASKED_INL(NAME, VALUE) (~(NAME ## _MASK | NAME ## __MASK) | (NAME ## _ ## VALUE))
 
-/* Create new etna context.
+/* Create new etna context, with the default command buffer configuration.
  * Return error when creation fails.
+ * Several contexts can be created on one connection and used from different
+ * threads (but each context from one thread at a time). Their commits are
+ * submitted in fence order. GPU state does not carry over between contexts:
+ * on kernels that use contexts, set a context callback or enable the state
+ * tracker; otherwise set all required state again after each flush.
  */
 int etna_create(struct viv_conn *conn, struct etna_ctx **ctx);
 
+/* Create new etna context with the given command buffer configuration.
+ * Return error when creation fails.
+ */
+int etna_create_config(struct viv_conn *conn, const struct etna_ctx_config *config, struct etna_ctx **ctx);
+
 /* Free an etna context. */
 int etna_free(struct etna_ctx *ctx);
 
@@ -212,7 +544,7 @@ static inline int etna_reserve(struct etna_ctx *ctx, size_t n)
 #endif
         ETNA_ALIGN(ctx);
 
-        if(((ctx->offset + n)*4 + END_COMMIT_CLEARANCE) <= COMMAND_BUFFER_SIZE) /* enough bytes free in buffer */
+        if(((ctx->offset + n)*4 + END_COMMIT_CLEARANCE) <= ctx->buffer_size) /* enough bytes free in buffer */
         {
             return ETNA_OK;
         }
@@ -220,15 +552,117 @@ static inline int etna_reserve(struct etna_ctx *ctx, size_t n)
     return _etna_reserve_internal(ctx, n);
 }
 
+/* Like etna_reserve, but instead of waiting for the GPU to release the next
+ * command buffer when the current one is full, return ETNA_WOULD_BLOCK.
+ * Nothing is committed in that case.
+ * @return OK on success, ETNA_WOULD_BLOCK, or error code otherwise
+ */
+int etna_try_reserve(struct etna_ctx *ctx, size_t n);
+
+/* Start writing up to n words through a cursor, see the ETNA_CURSOR_* macros.
+ * Nothing else may be emitted to ctx until etna_end_emit.
+ * @return pointer to write to, or NULL on error
+ */
+static inline uint32_t *etna_begin_emit(struct etna_ctx *ctx, size_t n)
+{
+    if(etna_reserve(ctx, n) != ETNA_OK)
+        return NULL;
+    return &ctx->buf[ctx->offset];
+}
+
+/* Finish writing through a cursor; cur points past the last word written */
+static inline void etna_end_emit(struct etna_ctx *ctx, uint32_t *cur)
+{
+    ctx->offset = cur - ctx->buf;
+#ifdef CMD_DEBUG
+    if((ctx->offset*4 + END_COMMIT_CLEARANCE) > ctx->buffer_size)
+        printf("etna_end_emit: wrote past end of buffer at offset %i\n", (int)ctx->offset);
+#endif
+}
+
 /* Set GPU pipe (ETNA_PIPE_2D, ETNA_PIPE_3D).
  */
 int etna_set_pipe(struct etna_ctx *ctx, enum etna_pipe pipe);
 
 /* Send currently queued commands to kernel.
+ * In asynchronous mode this only queues them for the submission thread;
+ * fences are still handed out in submission order.
  * @return OK on success, error code otherwise
  */
 int etna_flush(struct etna_ctx *ctx, uint32_t *fence_out);
 
+/* Like etna_flush, but return ETNA_WOULD_BLOCK without committing if the
+ * commit would use up the current command buffer while the next one is still
+ * in use by the GPU.
+ * @return OK on success, ETNA_WOULD_BLOCK, or error code otherwise
+ */
+int etna_try_flush(struct etna_ctx *ctx, uint32_t *fence_out);
+
+/* Enable or disable asynchronous mode, in which etna_flush hands off
+ * commits to a submission thread (see viv_async_start) instead of blocking
+ * in the kernel. Disabling waits for pending commits to be submitted.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_async(struct etna_ctx *ctx, bool enable);
+
+/* Copy command buffer usage statistics since creation or last reset to *stats.
+ * @return OK on success, error code otherwise
+ */
+int etna_get_stats(struct etna_ctx *ctx, struct etna_stats *stats);
+
+/* Reset command buffer usage statistics.
+ * @return OK on success, error code otherwise
+ */
+int etna_reset_stats(struct etna_ctx *ctx);
+
+/* Get default unsignalled flush policy for the kernel driver version of conn */
+void etna_get_default_flush_policy(struct viv_conn *conn, struct etna_flush_policy *policy);
+
+/* Set unsignalled flush policy.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_flush_policy(struct etna_ctx *ctx, const struct etna_flush_policy *policy);
+
+/* Enable or disable draw combining. When enabled, a draw of a list primitive
+ * type (points, lines, triangles) that directly follows a draw of the same
+ * type, and continues its range, is merged into the previous draw command
+ * instead of emitting a new one.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_draw_combining(struct etna_ctx *ctx, bool enable);
+
+/* Enable or disable deferred pipe switching. While enabled, etna_set_pipe
+ * doesn't emit a switch, but directs all following commands to a separate
+ * segment for that pipe. At etna_flush or etna_pipe_barrier the segments are
+ * written to the command buffer one pipe after another, starting with the
+ * pipe that is current there, so that each needs at most one real switch
+ * (two if the current pipe is not known).
+ * Commands are re-ordered between pipes, never within a pipe. If work on one
+ * pipe depends on earlier work on the other (e.g. a 2D blit of a 3D render
+ * target), call etna_pipe_barrier in between.
+ * Recording starts in the segment of the current pipe (3D if unknown).
+ * Disabling writes out the segments. Command blocks, fragments and replay
+ * can not be used while pipes are deferred, and the register shadow is
+ * invalidated on every segment switch. etna_try_flush can block while
+ * writing out the segments.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_pipe_deferral(struct etna_ctx *ctx, bool enable);
+
+/* Write out the commands recorded for each pipe so far, before continuing to
+ * record. No-op if pipes are not deferred.
+ * @return OK on success, error code otherwise
+ */
+int etna_pipe_barrier(struct etna_ctx *ctx);
+
+/* Enable or disable chaining, in which a full command buffer is continued in
+ * a segment that is reached with a LINK, instead of being flushed. This way a
+ * batch of any size is submitted in one commit. Segments are reused once the
+ * GPU is done with the command buffer they were chained from.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_chaining(struct etna_ctx *ctx, bool enable);
+
 /* Send currently queued commands to kernel, then block for them to finish.
  * @return OK on success, error code otherwise
  */
@@ -242,10 +676,62 @@ int etna_semaphore(struct etna_ctx *ctx, uint32_t from, uint32_t to);
 
 /* Queue a semaphore and stall.
  * from, to are values from SYNC_RECIPIENT_*.
+ * With stall elision enabled, nothing is queued if unit to had no work
+ * queued since the frontend last stalled on it.
  * @return OK on success, error code otherwise
  */
 int etna_stall(struct etna_ctx *ctx, uint32_t from, uint32_t to);
 
+/* Enable or disable stall elision. While enabled, etna_stall is skipped
+ * when the unit waited for has provably no outstanding work: nothing was
+ * queued for it since a frontend stall on it (or on a unit downstream of
+ * it) in the same commit. Draws, command blocks, fragments, replay and
+ * writes through etna_set_state* to registers that trigger an action (cache
+ * flushes, kickers) count as work. Every flush makes all units busy.
+ * Bare semaphores (etna_semaphore) are never skipped.
+ * @note Work queued with the ETNA_EMIT* macros directly is not seen; call
+ * etna_mark_units_busy after doing so.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_stall_elision(struct etna_ctx *ctx, bool enable);
+
+/* Record that work was queued for units (mask of ETNA_UNIT(SYNC_RECIPIENT_*),
+ * or ETNA_UNITS_*), so that the next stall on them is not skipped, and the
+ * caches they may have dirtied are flushed.
+ */
+static inline void etna_mark_units_busy(struct etna_ctx *ctx, uint32_t units)
+{
+    ctx->busy_units |= units;
+    ctx->dirty_units |= units;
+}
+
+/* Queue a flush of caches (VIVS_GL_FLUSH_CACHE_* bits). With flush elision
+ * enabled, only the caches that are dirty are flushed, and nothing is queued
+ * if none are.
+ * @return OK on success, error code otherwise
+ */
+int etna_flush_caches(struct etna_ctx *ctx, uint32_t caches);
+
+/* Enable or disable flush elision. While enabled, etna_flush_caches and the
+ * cache flush of etna_set_pipe skip caches that are not dirty. The color and
+ * depth caches are dirtied by 3D work, the PE2D cache by 2D work, and the
+ * texture and shader caches, which may hold stale data, by any work. Work is
+ * seen the same way as for stall elision (see etna_set_stall_elision), and
+ * every flush makes all caches dirty.
+ * @note Writes to memory by the CPU are not seen; call etna_mark_caches_dirty
+ * after writing memory that the GPU may have cached, such as texture uploads.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_flush_elision(struct etna_ctx *ctx, bool enable);
+
+/* Record that caches (VIVS_GL_FLUSH_CACHE_* bits) may hold stale data, so
+ * that the next flush of them is not skipped.
+ */
+static inline void etna_mark_caches_dirty(struct etna_ctx *ctx, uint32_t caches)
+{
+    ctx->dirty_caches |= caches;
+}
+
 /** Set callback for building context before flush.
  * Any etna state update commands called inside this callback function will be
  * part of context.
@@ -257,6 +743,226 @@ int etna_set_context_cb(struct etna_ctx *ctx, etna_context_snapshot_cb_t snapsho
 /* print command buffer for debugging */
 void etna_dump_cmd_buffer(struct etna_ctx *ctx);
 
+/** Start recording a command block.
+ * Subsequent etna_reserve and other state setting commands will go to
+ * the block instead of the command buffer, until etna_cmdblock_end.
+ * A block can hold at most buffer_size bytes of commands, and must
+ * leave the GPU pipe as it found it.
+ * @return OK on success, error code otherwise
+ */
+int etna_cmdblock_begin(struct etna_ctx *ctx);
+
+/** Finish recording a command block, and return it in *block_out.
+ * @return OK on success, error code otherwise
+ */
+int etna_cmdblock_end(struct etna_ctx *ctx, struct etna_cmdblock **block_out);
+
+/** Queue a CALL to a recorded command block (queues 4 words).
+ * @return OK on success, error code otherwise
+ */
+int etna_cmdblock_call(struct etna_ctx *ctx, const struct etna_cmdblock *block);
+
+/** Free a command block. The memory is released after the GPU is done with
+ * commands submitted so far.
+ * @return OK on success, error code otherwise
+ */
+int etna_cmdblock_free(struct etna_ctx *ctx, struct etna_cmdblock *block);
+
+/** Create a fragment: an etna_ctx that only records commands, into an
+ * arena that grows as needed. Fragments can be recorded on different threads
+ * with the usual ETNA_EMIT* and etna_set_state* functions, then appended to
+ * ctx with etna_ctx_append_fragments. They can not be flushed, and can not
+ * CALL command blocks.
+ * @return OK on success, error code otherwise
+ */
+int etna_fragment_create(struct etna_ctx *ctx, struct etna_ctx **frag_out);
+
+/** Clear a fragment for recording again, keeping its arena.
+ * @return OK on success, error code otherwise
+ */
+int etna_fragment_reset(struct etna_ctx *frag);
+
+/** Free a fragment.
+ * @return OK on success, error code otherwise
+ */
+int etna_fragment_free(struct etna_ctx *frag);
+
+/** Copy num fragments, in order, to the command buffer of ctx.
+ * A fragment that doesn't fit in the current command buffer is split between
+ * commands. The register shadow of ctx is invalidated, state loads are
+ * recorded in the state tracker, and the last pipe selected in a fragment
+ * becomes the current pipe.
+ * @return OK on success, error code otherwise
+ */
+int etna_ctx_append_fragments(struct etna_ctx *ctx, struct etna_ctx *const *frags, unsigned num);
+
+/** Replay the commits of a capture file made with viv_capture_start (see
+ * viv_capture.h) through ctx, one flush per captured commit. Context buffers
+ * and event queues in the capture are skipped. Captures with LINK or CALL
+ * commands (such as from chaining or command blocks) are refused as a whole,
+ * before anything is replayed.
+ * @note Only meaningful on the capturing system: the captured commands refer
+ * to GPU addresses of the capturing process.
+ * @return OK on success, error code otherwise
+ */
+int etna_replay(struct etna_ctx *ctx, const char *path);
+
+/* Size in words of the FE command starting at cmd, including padding to 64 bit */
+uint32_t etna_cmd_words(const uint32_t *cmd);
+
+/* Number of states written by the LOAD_STATE with header hdr */
+static inline uint32_t etna_load_state_count(uint32_t hdr)
+{
+    uint32_t count = (hdr & VIV_FE_LOAD_STATE_HEADER_COUNT__MASK) >> VIV_FE_LOAD_STATE_HEADER_COUNT__SHIFT;
+    return (count == 0) ? 1024 : count; /* COUNT 0 means 1024 */
+}
+
+/** Enable or disable the register shadow cache. When enabled, etna_set_state*
+ * skips writes of values that the register is already known to hold.
+ * The shadow is invalidated on every flush, as other clients may have changed
+ * the GPU state in between.
+ * @note State written with the ETNA_EMIT* macros directly is not tracked;
+ * call etna_shadow_invalidate for the affected range after doing so.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_shadow(struct etna_ctx *ctx, bool enable);
+
+/* Forget shadowed values for num state words starting at address base */
+void etna_shadow_invalidate(struct etna_ctx *ctx, uint32_t base, uint32_t num);
+
+/* internal (non-inline) part of etna_set_state_multi shadow check: trims
+ * the range to the words that differ from the shadow, and records the new values.
+ * @return false if the whole range is redundant. */
+bool _etna_shadow_update_multi(struct etna_ctx *ctx, uint32_t *base, uint32_t *num, const uint32_t **values);
+
+/* Check whether a state write can be appended to the last LOAD_STATE emitted
+ * by etna_set_state*: nothing was emitted since, the address is the next one
+ * in sequence and the FIXP flag matches. See etna_coalesce_state.
+ */
+static inline bool etna_coalesce_open(struct etna_ctx *ctx, uint32_t address, bool fixp)
+{
+    uint32_t end = ctx->coalesce_end;
+    uint32_t hdr, count;
+    /* offset may have been rounded up past the padding word by etna_reserve */
+    if(ctx->coalesce_buf != ctx->buf ||
+       !(ctx->offset == end || (ctx->offset == end + 1 && (end & 1))))
+        return false;
+    hdr = ctx->buf[ctx->coalesce_hdr];
+    count = etna_load_state_count(hdr); /* a full 1024-state block has COUNT 0 */
+    return ((hdr & VIV_FE_LOAD_STATE_HEADER_FIXP) != 0) == fixp &&
+           ((hdr & VIV_FE_LOAD_STATE_HEADER_OFFSET__MASK) + count) == (address >> 2) &&
+           count < ETNA_COALESCE_MAX_COUNT &&
+           ((end + 1)*4 + END_COMMIT_CLEARANCE) <= ctx->buffer_size;
+}
+
+/* Check state write against shadow and record it, without counting it.
+ * @return true if the write is redundant and can be skipped */
+static inline bool _etna_shadow_hit(struct etna_ctx *ctx, uint32_t address, uint32_t value)
+{
+    struct etna_shadow *shadow = ctx->shadow;
+    uint32_t idx = (address >> 2) & (ETNA_NUM_STATES - 1);
+    uint32_t bit = 1u << (idx & 31);
+    if(shadow == NULL || ctx->cur_buf <= ETNA_CTX_BUFFER) /* context, block or fragment buffer */
+        return false;
+    if((shadow->valid[idx >> 5] & bit) && shadow->values[idx] == value)
+        return true;
+    shadow->values[idx] = value;
+    shadow->valid[idx >> 5] |= shadow->cacheable[idx >> 5] & bit;
+    return false;
+}
+
+/* Check state write against shadow and record it.
+ * @return true if the write is redundant and can be skipped */
+static inline bool etna_shadow_update(struct etna_ctx *ctx, uint32_t address, uint32_t value)
+{
+    if(!_etna_shadow_hit(ctx, address, value))
+        return false;
+    /* a write that would have joined the open LOAD_STATE only costs its value */
+    ctx->stats.shadow_words_saved += etna_coalesce_open(ctx, address, false) ? 1 : 2;
+    return true;
+}
+
+/** Enable or disable the register state tracker. When enabled and no context
+ * callback is set, the context buffer is generated from the values last written
+ * through etna_set_state* to each register, restoring only registers that
+ * were written, each in the pipe it was last written in. Writes to trigger
+ * registers, and writes made inside command blocks or with the ETNA_EMIT*
+ * macros directly, are not tracked.
+ * @note The context is never generated if the kernel driver does not use contexts.
+ * @return OK on success, error code otherwise
+ */
+int etna_set_state_tracking(struct etna_ctx *ctx, bool enable);
+
+/* internal (non-inline) part of etna_set_state*_multi state tracking */
+void _etna_track_states(struct etna_ctx *ctx, uint32_t base, uint32_t num, const uint32_t *values, bool fixp);
+
+/* Internal: mark all units busy if any of num registers from base triggers
+ * an action, for stall and flush elision */
+void _etna_mark_busy_states(struct etna_ctx *ctx, uint32_t base, uint32_t num);
+
+/* Record state write in tracker. Values of registers that are already part of
+ * the context image are patched in place.
+ */
+static inline void etna_track_state(struct etna_ctx *ctx, uint32_t address, uint32_t value, bool fixp)
+{
+    struct etna_state_tracker *tracker = ctx->tracker;
+    uint32_t idx = (address >> 2) & (ETNA_NUM_STATES - 1);
+    uint32_t bit = 1u << (idx & 31);
+    if(tracker == NULL || ctx->cur_buf <= ETNA_CTX_BUFFER) /* context, block or fragment buffer */
+        return;
+    bool in_2d = ctx->cur_pipe == ETNA_PIPE_2D;
+    if(!(tracker->trackable[idx >> 5] & bit))
+        return;
+    tracker->values[idx] = value;
+    if((tracker->touched[idx >> 5] & bit) && ((tracker->fixp[idx >> 5] & bit) != 0) == fixp &&
+       ((tracker->pipe2d[idx >> 5] & bit) != 0) == in_2d)
+    {
+        if(!tracker->layout_dirty)
+            tracker->image[tracker->pos[idx]] = value;
+        return;
+    }
+    tracker->touched[idx >> 5] |= bit;
+    if(fixp)
+        tracker->fixp[idx >> 5] |= bit;
+    else
+        tracker->fixp[idx >> 5] &= ~bit;
+    if(in_2d)
+        tracker->pipe2d[idx >> 5] |= bit;
+    else
+        tracker->pipe2d[idx >> 5] &= ~bit;
+    tracker->layout_dirty = true;
+}
+
+/* Try to append a state write to the last LOAD_STATE emitted by etna_set_state*.
+ * @return true if the value was appended
+ */
+static inline bool etna_coalesce_state(struct etna_ctx *ctx, uint32_t address, uint32_t value, bool fixp)
+{
+    uint32_t end = ctx->coalesce_end;
+    uint32_t hdr;
+    if(!etna_coalesce_open(ctx, address, fixp))
+        return false;
+    hdr = ctx->buf[ctx->coalesce_hdr];
+    ctx->buf[ctx->coalesce_hdr] = (hdr & ~VIV_FE_LOAD_STATE_HEADER_COUNT__MASK) |
+        VIV_FE_LOAD_STATE_HEADER_COUNT(etna_load_state_count(hdr) + 1);
+    ctx->buf[end] = value;
+    ctx->offset = ctx->coalesce_end = end + 1;
+    return true;
+}
+
+/* Emit a single state write, keeping its LOAD_STATE open for coalescing */
+static inline void etna_emit_state_open(struct etna_ctx *ctx, uint32_t address, uint32_t value, bool fixp)
+{
+    if(etna_coalesce_state(ctx, address, value, fixp))
+        return;
+    etna_reserve(ctx, 2);
+    ctx->coalesce_buf = ctx->buf;
+    ctx->coalesce_hdr = ctx->offset;
+    ETNA_EMIT_LOAD_STATE(ctx, address >> 2, 1, fixp);
+    ETNA_EMIT(ctx, value);
+    ctx->coalesce_end = ctx->offset;
+}
+
 /**
  * Direct state setting functions; these can be used for convenience. When absolute performance
  * is required while updating big blocks of state at once, it is recommended to use the
@@ -264,18 +970,30 @@ void etna_dump_cmd_buffer(struct etna_ctx *ctx);
  */
 static inline void etna_set_state(struct etna_ctx *cmdbuf, uint32_t address, uint32_t value)
 {
-    etna_reserve(cmdbuf, 2);
-    ETNA_EMIT_LOAD_STATE(cmdbuf, address >> 2, 1, 0);
-    ETNA_EMIT(cmdbuf, value);
+    etna_track_state(cmdbuf, address, value, false);
+    if(cmdbuf->elide_stalls || cmdbuf->elide_flushes)
+        _etna_mark_busy_states(cmdbuf, address, 1);
+    if(etna_shadow_update(cmdbuf, address, value))
+        return;
+    etna_emit_state_open(cmdbuf, address, value, false);
 }
 
 static inline void etna_set_state_multi(struct etna_ctx *cmdbuf, uint32_t base, uint32_t num, const uint32_t *values)
 {
     if(num == 0) return;
+    if(cmdbuf->tracker)
+        _etna_track_states(cmdbuf, base, num, values, false);
+    if(cmdbuf->elide_stalls || cmdbuf->elide_flushes)
+        _etna_mark_busy_states(cmdbuf, base, num);
+    if(cmdbuf->shadow && !_etna_shadow_update_multi(cmdbuf, &base, &num, &values))
+        return;
     etna_reserve(cmdbuf, 1 + num + 1); /* 1 extra for potential alignment */
+    cmdbuf->coalesce_buf = cmdbuf->buf;
+    cmdbuf->coalesce_hdr = cmdbuf->offset;
     ETNA_EMIT_LOAD_STATE(cmdbuf, base >> 2, num, 0);
     memcpy(&cmdbuf->buf[cmdbuf->offset], values, 4*num);
     cmdbuf->offset += num;
+    cmdbuf->coalesce_end = cmdbuf->offset;
     ETNA_ALIGN(cmdbuf);
 }
 
@@ -285,18 +1003,68 @@ static inline void etna_set_state_f32(struct etna_ctx *cmdbuf, uint32_t address,
 }
 static inline void etna_set_state_fixp(struct etna_ctx *cmdbuf, uint32_t address, uint32_t value)
 {
-    etna_reserve(cmdbuf, 2);
-    ETNA_EMIT_LOAD_STATE(cmdbuf, address >> 2, 1, 1);
-    ETNA_EMIT(cmdbuf, value);
+    etna_track_state(cmdbuf, address, value, true);
+    if(cmdbuf->elide_stalls || cmdbuf->elide_flushes)
+        _etna_mark_busy_states(cmdbuf, address, 1);
+    if(cmdbuf->shadow) /* value is converted by the FE, don't try to shadow it */
+        etna_shadow_invalidate(cmdbuf, address, 1);
+    etna_emit_state_open(cmdbuf, address, value, true);
 }
 static inline void etna_set_state_fixp_multi(struct etna_ctx *cmdbuf, uint32_t address, uint32_t num, uint32_t *values)
 {
+    if(cmdbuf->tracker)
+        _etna_track_states(cmdbuf, address, num, values, true);
+    if(cmdbuf->elide_stalls || cmdbuf->elide_flushes)
+        _etna_mark_busy_states(cmdbuf, address, num);
+    if(cmdbuf->shadow)
+        etna_shadow_invalidate(cmdbuf, address, num);
     etna_reserve(cmdbuf, 1 + num + 1); /* 1 extra for potential alignment */
+    cmdbuf->coalesce_buf = cmdbuf->buf;
+    cmdbuf->coalesce_hdr = cmdbuf->offset;
     ETNA_EMIT_LOAD_STATE(cmdbuf, address >> 2, num, 1);
     memcpy(&cmdbuf->buf[cmdbuf->offset], values, 4*num);
     cmdbuf->offset += num;
+    cmdbuf->coalesce_end = cmdbuf->offset;
     ETNA_ALIGN(cmdbuf);
 }
+/* Try to merge a draw into the last draw command. This is possible if nothing
+ * was emitted since, the primitive type is a list type, and the draw continues
+ * where the last one ended.
+ * @return true if the draw was merged
+ */
+static inline bool etna_combine_draw(struct etna_ctx *ctx, uint32_t primitive_type, uint32_t start, uint32_t count, bool indexed, uint32_t offset)
+{
+    uint32_t *draw;
+    uint32_t vertices;
+    if(!ctx->combine_draws || ctx->draw_buf != ctx->buf || ctx->offset != ctx->draw_end)
+        return false;
+    switch(primitive_type)
+    {
+    case PRIMITIVE_TYPE_POINTS: vertices = 1; break;
+    case PRIMITIVE_TYPE_LINES: vertices = 2; break;
+    case PRIMITIVE_TYPE_TRIANGLES: vertices = 3; break;
+    default: return false; /* strips, fans and loops would be connected */
+    }
+    draw = &ctx->buf[ctx->draw_hdr];
+    if(draw[0] != (indexed ? VIV_FE_DRAW_INDEXED_PRIMITIVES_HEADER_OP_DRAW_INDEXED_PRIMITIVES :
+                             VIV_FE_DRAW_PRIMITIVES_HEADER_OP_DRAW_PRIMITIVES) ||
+       draw[1] != primitive_type ||
+       (draw[2] + draw[3] * vertices) != start ||
+       (indexed && draw[4] != offset))
+        return false;
+    draw[3] += count;
+    ctx->stats.draws_combined += 1;
+    return true;
+}
+
+/* Remember draw command at offset hdr, just emitted, for etna_combine_draw */
+static inline void etna_record_draw(struct etna_ctx *ctx, uint32_t hdr)
+{
+    ctx->draw_buf = ctx->buf;
+    ctx->draw_hdr = hdr;
+    ctx->draw_end = ctx->offset;
+}
+
 static inline void etna_draw_primitives(struct etna_ctx *cmdbuf, uint32_t primitive_type, uint32_t start, uint32_t count)
 {
 #ifdef CMD_DEBUG
@@ -304,8 +1072,13 @@ static inline void etna_draw_primitives(struct etna_ctx *cmdbuf, uint32_t primit
             VIV_FE_DRAW_PRIMITIVES_HEADER_OP_DRAW_PRIMITIVES,
             primitive_type, start, count);
 #endif
+    etna_mark_units_busy(cmdbuf, ETNA_UNITS_3D);
+    if(etna_combine_draw(cmdbuf, primitive_type, start, count, false, 0))
+        return;
     etna_reserve(cmdbuf, 4);
+    uint32_t hdr = cmdbuf->offset;
     ETNA_EMIT_DRAW_PRIMITIVES(cmdbuf, primitive_type, start, count);
+    etna_record_draw(cmdbuf, hdr);
 }
 static inline void etna_draw_indexed_primitives(struct etna_ctx *cmdbuf, uint32_t primitive_type, uint32_t start, uint32_t count, uint32_t offset)
 {
@@ -314,10 +1087,40 @@ static inline void etna_draw_indexed_primitives(struct etna_ctx *cmdbuf, uint32_
             VIV_FE_DRAW_PRIMITIVES_HEADER_OP_DRAW_INDEXED_PRIMITIVES,
             primitive_type, start, count);
 #endif
+    etna_mark_units_busy(cmdbuf, ETNA_UNITS_3D);
+    if(etna_combine_draw(cmdbuf, primitive_type, start, count, true, offset))
+        return;
     etna_reserve(cmdbuf, 5+1);
+    uint32_t hdr = cmdbuf->offset;
     ETNA_EMIT_DRAW_INDEXED_PRIMITIVES(cmdbuf, primitive_type, start, count, offset);
+    etna_record_draw(cmdbuf, hdr);
 }
 
+/* State write done before a draw in a multi-draw */
+struct etna_state_write {
+    uint32_t address;
+    uint32_t value;
+};
+
+/* One draw in a multi-draw */
+struct etna_draw {
+    uint32_t start;
+    uint32_t count;
+    uint32_t offset; /* only used for indexed draws */
+    /* optional state writes to do before the draw */
+    unsigned num_states;
+    const struct etna_state_write *states;
+};
+
+/** Queue num draws of the same primitive type, reserving space once for as
+ * many draws as fit. State writes of a draw to consecutive addresses are
+ * joined into one LOAD_STATE, and go through the register shadow and state
+ * tracker like etna_set_state.
+ * @return OK on success, error code otherwise
+ */
+int etna_draw_primitives_multi(struct etna_ctx *ctx, uint32_t primitive_type, const struct etna_draw *draws, unsigned num);
+int etna_draw_indexed_primitives_multi(struct etna_ctx *ctx, uint32_t primitive_type, const struct etna_draw *draws, unsigned num);
+
 /* ETNA_COALESCE
  *
  * Mechanism to emit state changes and join consecutive
@@ -342,6 +1145,9 @@ static inline void etna_draw_indexed_primitives(struct etna_ctx *cmdbuf, uint32_
  * thus the next register that will be written. If the register number to be written
  * matches this next register, add it to the current span. If not, close the span
  * and open a new one.
+ *
+ * etna_set_state and etna_set_state_fixp do the same at run time (see
+ * etna_coalesce_state), these macros remain cheaper for large known blocks of state.
  */
 #define ETNA_COALESCE_STATE_OPEN(max_updates) \
     etna_reserve(ctx, (max_updates) * 2); \
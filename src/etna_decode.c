@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <etna_decode.h>
+#include <etna.h>
+#include <viv_capture.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "etna_state_names.h"
+
+#define OPCODE(x) ((x) >> VIV_FE_LOAD_STATE_HEADER_OP__SHIFT)
+
+struct etna_decoder {
+    struct etna_decode_stats stats;
+    uint32_t values[ETNA_DECODE_NUM_STATES];
+    uint32_t valid[ETNA_DECODE_NUM_STATES / 32]; /* bitmask, value known */
+    uint32_t writes[ETNA_DECODE_NUM_STATES];
+    uint32_t redundant[ETNA_DECODE_NUM_STATES];
+};
+
+static const struct etna_opcode_info {
+    const char *name;
+    uint32_t words; /* size in words including padding, 0 if variable */
+} etna_opcodes[ETNA_DECODE_NUM_OPCODES] = {
+    [OPCODE(VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE)] = {"LOAD_STATE", 0},
+    [OPCODE(VIV_FE_END_HEADER_OP_END)] = {"END", 2},
+    [OPCODE(VIV_FE_NOP_HEADER_OP_NOP)] = {"NOP", 2},
+    [OPCODE(VIV_FE_DRAW_2D_HEADER_OP_DRAW_2D)] = {"DRAW_2D", 0},
+    [OPCODE(VIV_FE_DRAW_PRIMITIVES_HEADER_OP_DRAW_PRIMITIVES)] = {"DRAW_PRIMITIVES", 4},
+    [OPCODE(VIV_FE_DRAW_INDEXED_PRIMITIVES_HEADER_OP_DRAW_INDEXED_PRIMITIVES)] = {"DRAW_INDEXED_PRIMITIVES", 6},
+    [OPCODE(VIV_FE_WAIT_HEADER_OP_WAIT)] = {"WAIT", 2},
+    [OPCODE(VIV_FE_LINK_HEADER_OP_LINK)] = {"LINK", 2},
+    [OPCODE(VIV_FE_STALL_HEADER_OP_STALL)] = {"STALL", 2},
+    [OPCODE(VIV_FE_CALL_HEADER_OP_CALL)] = {"CALL", 4},
+    [OPCODE(VIV_FE_RETURN_HEADER_OP_RETURN)] = {"RETURN", 2},
+    [OPCODE(VIV_FE_CHIP_SELECT_HEADER_OP_CHIP_SELECT)] = {"CHIP_SELECT", 2},
+};
+
+static const struct etna_state_info *find_state(uint32_t address, uint32_t *index_out)
+{
+    const unsigned num = sizeof(etna_state_info) / sizeof(etna_state_info[0]);
+    /* find last entry starting at or before address */
+    unsigned lo = 0, hi = num;
+    while(lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+        if(etna_state_info[mid].address <= address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    /* arrays can enclose later entries of other units, so look further back */
+    while(lo > 0)
+    {
+        const struct etna_state_info *info = &etna_state_info[--lo];
+        uint32_t delta = address - info->address;
+        if(delta < info->stride * info->length && (delta % info->stride) == 0)
+        {
+            if(index_out)
+                *index_out = delta / info->stride;
+            return info;
+        }
+    }
+    return NULL;
+}
+
+int etna_decoder_create(struct etna_decoder **decoder_out)
+{
+    if(decoder_out == NULL)
+        return ETNA_INVALID_ADDR;
+    struct etna_decoder *decoder = ETNA_CALLOC_STRUCT(etna_decoder);
+    if(decoder == NULL)
+        return ETNA_OUT_OF_MEMORY;
+    *decoder_out = decoder;
+    return ETNA_OK;
+}
+
+void etna_decoder_free(struct etna_decoder *decoder)
+{
+    ETNA_FREE(decoder);
+}
+
+void etna_decoder_reset(struct etna_decoder *decoder)
+{
+    memset(decoder, 0, sizeof(struct etna_decoder));
+}
+
+void etna_decoder_invalidate(struct etna_decoder *decoder)
+{
+    memset(decoder->valid, 0, sizeof(decoder->valid));
+}
+
+static void decode_load_state(struct etna_decoder *decoder, uint32_t hdr, const uint32_t *values)
+{
+    uint32_t offset = (hdr & VIV_FE_LOAD_STATE_HEADER_OFFSET__MASK) >> VIV_FE_LOAD_STATE_HEADER_OFFSET__SHIFT;
+    uint32_t count = etna_load_state_count(hdr);
+    decoder->stats.load_state_headers += 1;
+    decoder->stats.state_writes += count;
+    for(uint32_t i=0; i<count; ++i)
+    {
+        uint32_t idx = (offset + i) & (ETNA_DECODE_NUM_STATES - 1);
+        uint32_t mask = 1u << (idx & 31);
+        decoder->writes[idx] += 1;
+        if((decoder->valid[idx >> 5] & mask) && decoder->values[idx] == values[i])
+        {
+            decoder->redundant[idx] += 1;
+            decoder->stats.redundant_writes += 1;
+        }
+        decoder->values[idx] = values[i];
+        decoder->valid[idx >> 5] |= mask;
+    }
+}
+
+int etna_decode(struct etna_decoder *decoder, const uint32_t *buf, size_t count)
+{
+    size_t pos = 0;
+    if(decoder == NULL || (buf == NULL && count != 0))
+        return ETNA_INVALID_ADDR;
+    while(pos < count)
+    {
+        uint32_t hdr = buf[pos];
+        uint32_t op = OPCODE(hdr);
+        const struct etna_opcode_info *info = &etna_opcodes[op];
+        if(info->name == NULL)
+        {
+#ifdef DEBUG
+            fprintf(stderr, "%s: unknown opcode %08x at word %u\n", __func__, hdr, (unsigned)pos);
+#endif
+            decoder->stats.invalid += 1;
+            return ETNA_INVALID_VALUE;
+        }
+        uint32_t words = info->words ? info->words : etna_cmd_words(&buf[pos]);
+        if(pos + words > count)
+        {
+            decoder->stats.invalid += 1;
+            return ETNA_INVALID_VALUE;
+        }
+        if(op == OPCODE(VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE))
+            decode_load_state(decoder, hdr, &buf[pos + 1]);
+        decoder->stats.commands += 1;
+        decoder->stats.words += words;
+        decoder->stats.opcode_count[op] += 1;
+        decoder->stats.opcode_words[op] += words;
+        pos += words;
+    }
+    return ETNA_OK;
+}
+
+static int decode_commit(void *data, uint64_t timestamp, const struct viv_capture_commit *commit, const uint32_t *words)
+{
+    /* the clearance at the start of each commit is not written by etna */
+    uint32_t skip = (commit->count < BEGIN_COMMIT_CLEARANCE/4) ? commit->count : BEGIN_COMMIT_CLEARANCE/4;
+    (void)timestamp;
+    return etna_decode(data, &words[skip], commit->count - skip);
+}
+
+int etna_decode_capture(struct etna_decoder *decoder, const char *path)
+{
+    if(decoder == NULL || path == NULL)
+        return ETNA_INVALID_ADDR;
+    struct viv_replay_backend backend = {
+        .commit = decode_commit,
+        .data = decoder
+    };
+    return viv_replay(path, &backend);
+}
+
+void etna_decoder_get_stats(const struct etna_decoder *decoder, struct etna_decode_stats *stats)
+{
+    *stats = decoder->stats;
+}
+
+unsigned etna_decoder_top_states(const struct etna_decoder *decoder, struct etna_decode_state_count *out, unsigned max_out)
+{
+    unsigned num = 0;
+    for(uint32_t idx=0; idx<ETNA_DECODE_NUM_STATES && max_out; ++idx)
+    {
+        uint32_t writes = decoder->writes[idx];
+        if(writes == 0 || (num == max_out && writes <= out[num - 1].writes))
+            continue;
+        /* insertion into sorted list, dropping the last entry if full */
+        unsigned pos = (num < max_out) ? num++ : num - 1;
+        while(pos > 0 && out[pos - 1].writes < writes)
+        {
+            out[pos] = out[pos - 1];
+            pos -= 1;
+        }
+        out[pos].address = idx << 2;
+        out[pos].writes = writes;
+        out[pos].redundant = decoder->redundant[idx];
+    }
+    return num;
+}
+
+void etna_decoder_print(const struct etna_decoder *decoder, FILE *out, unsigned top_n)
+{
+    const struct etna_decode_stats *stats = &decoder->stats;
+    fprintf(out, "%llu words, %llu commands", (unsigned long long)stats->words, (unsigned long long)stats->commands);
+    if(stats->invalid)
+        fprintf(out, ", %llu invalid", (unsigned long long)stats->invalid);
+    fprintf(out, "\n%-24s %10s %10s\n", "opcode", "count", "words");
+    for(uint32_t op=0; op<ETNA_DECODE_NUM_OPCODES; ++op)
+    {
+        if(stats->opcode_count[op] == 0)
+            continue;
+        fprintf(out, "%-24s %10llu %10llu\n", etna_opcodes[op].name,
+                (unsigned long long)stats->opcode_count[op], (unsigned long long)stats->opcode_words[op]);
+    }
+    if(stats->load_state_headers)
+    {
+        fprintf(out, "%llu state writes in %llu LOAD_STATE headers (%.2f states per header), %llu redundant (%.1f%%)\n",
+                (unsigned long long)stats->state_writes, (unsigned long long)stats->load_state_headers,
+                (double)stats->state_writes / stats->load_state_headers,
+                (unsigned long long)stats->redundant_writes,
+                stats->state_writes ? 100.0 * stats->redundant_writes / stats->state_writes : 0.0);
+    }
+    if(top_n == 0)
+        return;
+    struct etna_decode_state_count *top = ETNA_CALLOC_STRUCT_ARRAY(top_n, etna_decode_state_count);
+    if(top == NULL)
+        return;
+    unsigned num = etna_decoder_top_states(decoder, top, top_n);
+    fprintf(out, "%-7s %-40s %10s %10s\n", "address", "state", "writes", "redundant");
+    for(unsigned x=0; x<num; ++x)
+    {
+        char name[64];
+        uint32_t index = 0;
+        const struct etna_state_info *info = find_state(top[x].address, &index);
+        if(info == NULL)
+            snprintf(name, sizeof(name), "UNKNOWN");
+        else if(info->length > 1)
+            snprintf(name, sizeof(name), "%s[%u]", info->name, index);
+        else
+            snprintf(name, sizeof(name), "%s", info->name);
+        fprintf(out, "0x%05x %-40s %10u %10u\n", top[x].address, name, top[x].writes, top[x].redundant);
+    }
+    ETNA_FREE(top);
+}
+
+const char *etna_opcode_name(uint32_t opcode)
+{
+    if(opcode >= ETNA_DECODE_NUM_OPCODES)
+        return NULL;
+    return etna_opcodes[opcode].name;
+}
+
+const char *etna_state_name(uint32_t address, uint32_t *index_out)
+{
+    const struct etna_state_info *info = find_state(address, index_out);
+    return info ? info->name : NULL;
+}
+
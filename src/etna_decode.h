@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+/* Command stream decoder and statistics.
+ * Walks command buffers (live, or from a capture file) and counts commands
+ * per opcode, state loads, and register writes that don't change the value
+ * the register already had.
+ */
+#ifndef H_ETNA_DECODE
+#define H_ETNA_DECODE
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Number of FE opcodes, VIV_FE_*_HEADER_OP >> 27 */
+#define ETNA_DECODE_NUM_OPCODES 32
+/* Number of register words addressable through LOAD_STATE */
+#define ETNA_DECODE_NUM_STATES 0x10000
+
+struct etna_decoder;
+
+struct etna_decode_stats {
+    uint64_t words; /* words decoded, including padding */
+    uint64_t commands; /* commands decoded */
+    uint64_t opcode_count[ETNA_DECODE_NUM_OPCODES]; /* commands per opcode */
+    uint64_t opcode_words[ETNA_DECODE_NUM_OPCODES]; /* words per opcode, including padding */
+    uint64_t load_state_headers; /* LOAD_STATE commands */
+    uint64_t state_writes; /* registers written by LOAD_STATE */
+    uint64_t redundant_writes; /* writes of the value a register already had */
+    uint64_t invalid; /* unknown opcodes and commands truncated by end of buffer */
+};
+
+/* Per-register write counts, as returned by etna_decoder_top_states */
+struct etna_decode_state_count {
+    uint32_t address; /* byte address, as VIVS_* */
+    uint32_t writes;
+    uint32_t redundant;
+};
+
+/** Create a decoder with empty statistics and no known register values.
+ */
+int etna_decoder_create(struct etna_decoder **decoder_out);
+
+/** Free a decoder.
+ */
+void etna_decoder_free(struct etna_decoder *decoder);
+
+/** Clear statistics and forget register values.
+ */
+void etna_decoder_reset(struct etna_decoder *decoder);
+
+/** Forget register values, but keep statistics. Use when the GPU state is
+ * unknown, for example after a context switch.
+ */
+void etna_decoder_invalidate(struct etna_decoder *decoder);
+
+/** Decode count words of commands, adding to the statistics. Register values
+ * are carried over from previously decoded buffers.
+ * LINK and CALL targets are not followed.
+ * @return OK on success, ETNA_INVALID_VALUE if the buffer contains unknown
+ * or truncated commands (decoding stops there)
+ */
+int etna_decode(struct etna_decoder *decoder, const uint32_t *buf, size_t count);
+
+/** Decode all commits in a capture file (see viv_capture.h).
+ * Context buffers are not counted, as they restore state by design.
+ */
+int etna_decode_capture(struct etna_decoder *decoder, const char *path);
+
+/** Get statistics so far.
+ */
+void etna_decoder_get_stats(const struct etna_decoder *decoder, struct etna_decode_stats *stats);
+
+/** Get the registers written most often, sorted by decreasing write count.
+ * @return number of entries filled in, at most max_out
+ */
+unsigned etna_decoder_top_states(const struct etna_decoder *decoder, struct etna_decode_state_count *out, unsigned max_out);
+
+/** Print statistics and the top_n most often written registers.
+ */
+void etna_decoder_print(const struct etna_decoder *decoder, FILE *out, unsigned top_n);
+
+/** Name of FE opcode (header >> 27), or NULL if unknown.
+ */
+const char *etna_opcode_name(uint32_t opcode);
+
+/** Name of register at byte address (without VIVS_ prefix), or NULL if unknown.
+ * For register arrays, the element index is returned in index_out (0 otherwise).
+ */
+const char *etna_state_name(uint32_t address, uint32_t *index_out);
+
+#endif
+
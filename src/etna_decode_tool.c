@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+/* Print command stream statistics of capture files (see viv_capture.h):
+ * commands per opcode, state writes, and the registers written most often.
+ * Several files are summed.
+ *
+ *   etna-decode [-n top_states] capture...
+ */
+#include <etna.h>
+#include <etna_decode.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_TOP_STATES (20)
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n top_states] capture...\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct etna_decoder *decoder = NULL;
+    unsigned top_n = DEFAULT_TOP_STATES;
+    int rv = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            top_n = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if(etna_decoder_create(&decoder) != ETNA_OK)
+    {
+        fprintf(stderr, "Unable to create decoder\n");
+        return 1;
+    }
+    for(int x=optind; x<argc; ++x)
+    {
+        int status;
+        /* State does not carry over between captures */
+        etna_decoder_invalidate(decoder);
+        if((status = etna_decode_capture(decoder, argv[x])) != ETNA_OK)
+        {
+            fprintf(stderr, "%s: error %i decoding capture\n", argv[x], status);
+            rv = 1;
+        }
+    }
+    etna_decoder_print(decoder, stdout, top_n);
+    etna_decoder_free(decoder);
+    return rv;
+}
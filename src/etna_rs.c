@@ -132,6 +132,8 @@ void etna_compile_rs_state(struct etna_ctx *restrict ctx, struct compiled_rs_sta
  * except TS if this is a source-to-destination blit. */
 void etna_submit_rs_state(struct etna_ctx *restrict ctx, const struct compiled_rs_state *cs)
 {
+    /* RS state is emitted directly, make sure the shadow does not go stale */
+    etna_shadow_invalidate(ctx, VIVS_RS_CONFIG, (VIVS_RS_PIPE_OFFSET(VIVS_RS_PIPE__LEN) - VIVS_RS_CONFIG) >> 2);
     if (ctx->conn->chip.pixel_pipes == 1)
     {
         etna_reserve(ctx, 22);
@@ -212,5 +214,6 @@ void etna_submit_rs_state(struct etna_ctx *restrict ctx, const struct compiled_r
         /*32*/ ETNA_EMIT_LOAD_STATE(ctx, VIVS_RS_KICKER>>2, 1, 0);
         /*33*/ ETNA_EMIT(ctx, 0xbeebbeeb);
     }
+    etna_mark_units_busy(ctx, ETNA_UNITS_ALL);
 }
 
@@ -0,0 +1,435 @@
+#ifndef ETNA_STATE_NAMES
+#define ETNA_STATE_NAMES
+
+/* Autogenerated file, DO NOT EDIT manually!
+
+Register table generated from the register definitions in
+state.xml.h, state_2d.xml.h, state_3d.xml.h and state_vg.xml.h,
+sorted by address. Stripes are flattened into their member arrays.
+Host interface registers (state_hi.xml.h) are not loadable
+through the command stream, and are left out.
+*/
+
+struct etna_state_info {
+    uint32_t address; /* byte address of first element */
+    uint32_t stride; /* distance between elements in bytes */
+    uint32_t length; /* number of elements, 1 for single registers */
+    const char *name;
+};
+
+static const struct etna_state_info etna_state_info[] = {
+    {0x00600, 0x4, 16, "FE_VERTEX_ELEMENT_CONFIG"},
+    {0x00640, 0x4, 1, "FE_CMD_STREAM_BASE_ADDR"},
+    {0x00644, 0x4, 1, "FE_INDEX_STREAM_BASE_ADDR"},
+    {0x00648, 0x4, 1, "FE_INDEX_STREAM_CONTROL"},
+    {0x0064c, 0x4, 1, "FE_VERTEX_STREAM_BASE_ADDR"},
+    {0x00650, 0x4, 1, "FE_VERTEX_STREAM_CONTROL"},
+    {0x00654, 0x4, 1, "FE_COMMAND_ADDRESS"},
+    {0x00658, 0x4, 1, "FE_COMMAND_CONTROL"},
+    {0x0065c, 0x4, 1, "FE_DMA_STATUS"},
+    {0x00660, 0x4, 1, "FE_DMA_DEBUG_STATE"},
+    {0x00664, 0x4, 1, "FE_DMA_ADDRESS"},
+    {0x00668, 0x4, 1, "FE_DMA_LOW"},
+    {0x0066c, 0x4, 1, "FE_DMA_HIGH"},
+    {0x00670, 0x4, 1, "FE_AUTO_FLUSH"},
+    {0x00678, 0x4, 1, "FE_UNK00678"},
+    {0x0067c, 0x4, 1, "FE_UNK0067C"},
+    {0x00680, 0x4, 8, "FE_VERTEX_STREAMS_BASE_ADDR"},
+    {0x006a0, 0x4, 8, "FE_VERTEX_STREAMS_CONTROL"},
+    {0x00700, 0x4, 16, "FE_UNK00700"},
+    {0x00740, 0x4, 16, "FE_UNK00740"},
+    {0x00780, 0x4, 16, "FE_UNK00780"},
+    {0x00800, 0x4, 1, "VS_END_PC"},
+    {0x00804, 0x4, 1, "VS_OUTPUT_COUNT"},
+    {0x00808, 0x4, 1, "VS_INPUT_COUNT"},
+    {0x0080c, 0x4, 1, "VS_TEMP_REGISTER_CONTROL"},
+    {0x00810, 0x4, 4, "VS_OUTPUT"},
+    {0x00820, 0x4, 4, "VS_INPUT"},
+    {0x00830, 0x4, 1, "VS_LOAD_BALANCING"},
+    {0x00834, 0x4, 1, "VS_PERF_COUNTER"},
+    {0x00838, 0x4, 1, "VS_START_PC"},
+    {0x00850, 0x4, 1, "VS_UNK00850"},
+    {0x00854, 0x4, 1, "VS_UNK00854"},
+    {0x00858, 0x4, 1, "VS_UNK00858"},
+    {0x0085c, 0x4, 1, "VS_RANGE"},
+    {0x00860, 0x4, 1, "VS_NEW_UNK00860"},
+    {0x00900, 0x4, 1, "CL_CONFIG"},
+    {0x00904, 0x4, 1, "CL_GLOBAL_X"},
+    {0x00908, 0x4, 1, "CL_GLOBAL_Y"},
+    {0x0090c, 0x4, 1, "CL_GLOBAL_Z"},
+    {0x00910, 0x4, 1, "CL_WORKGROUP_X"},
+    {0x00914, 0x4, 1, "CL_WORKGROUP_Y"},
+    {0x00918, 0x4, 1, "CL_WORKGROUP_Z"},
+    {0x0091c, 0x4, 1, "CL_THREAD_ALLOCATION"},
+    {0x00920, 0x4, 1, "CL_KICKER"},
+    {0x00924, 0x4, 1, "CL_UNK00924"},
+    {0x00a00, 0x4, 1, "PA_VIEWPORT_SCALE_X"},
+    {0x00a04, 0x4, 1, "PA_VIEWPORT_SCALE_Y"},
+    {0x00a08, 0x4, 1, "PA_VIEWPORT_SCALE_Z"},
+    {0x00a0c, 0x4, 1, "PA_VIEWPORT_OFFSET_X"},
+    {0x00a10, 0x4, 1, "PA_VIEWPORT_OFFSET_Y"},
+    {0x00a14, 0x4, 1, "PA_VIEWPORT_OFFSET_Z"},
+    {0x00a18, 0x4, 1, "PA_LINE_WIDTH"},
+    {0x00a1c, 0x4, 1, "PA_POINT_SIZE"},
+    {0x00a28, 0x4, 1, "PA_SYSTEM_MODE"},
+    {0x00a2c, 0x4, 1, "PA_W_CLIP_LIMIT"},
+    {0x00a30, 0x4, 1, "PA_ATTRIBUTE_ELEMENT_COUNT"},
+    {0x00a34, 0x4, 1, "PA_CONFIG"},
+    {0x00a38, 0x4, 1, "PA_LINE_UNK00A38"},
+    {0x00a3c, 0x4, 1, "PA_LINE_UNK00A3C"},
+    {0x00a40, 0x4, 10, "PA_SHADER_ATTRIBUTES"},
+    {0x00a80, 0x4, 1, "PA_VIEWPORT_UNK00A80"},
+    {0x00a84, 0x4, 1, "PA_VIEWPORT_UNK00A84"},
+    {0x00a8c, 0x4, 1, "PA_VIEWPORT_UNK00A8C"},
+    {0x00c00, 0x4, 1, "SE_SCISSOR_LEFT"},
+    {0x00c04, 0x4, 1, "SE_SCISSOR_TOP"},
+    {0x00c08, 0x4, 1, "SE_SCISSOR_RIGHT"},
+    {0x00c0c, 0x4, 1, "SE_SCISSOR_BOTTOM"},
+    {0x00c10, 0x4, 1, "SE_DEPTH_SCALE"},
+    {0x00c14, 0x4, 1, "SE_DEPTH_BIAS"},
+    {0x00c18, 0x4, 1, "SE_CONFIG"},
+    {0x00c1c, 0x4, 1, "SE_UNK00C1C"},
+    {0x00c20, 0x4, 1, "SE_CLIP_RIGHT"},
+    {0x00c24, 0x4, 1, "SE_CLIP_BOTTOM"},
+    {0x00e00, 0x4, 1, "RA_CONTROL"},
+    {0x00e04, 0x4, 1, "RA_MULTISAMPLE_UNK00E04"},
+    {0x00e08, 0x4, 1, "RA_EARLY_DEPTH"},
+    {0x00e10, 0x4, 4, "RA_MULTISAMPLE_UNK00E10"},
+    {0x00e40, 0x4, 16, "RA_CENTROID_TABLE"},
+    {0x01000, 0x4, 1, "PS_END_PC"},
+    {0x01004, 0x4, 1, "PS_OUTPUT_REG"},
+    {0x01008, 0x4, 1, "PS_INPUT_COUNT"},
+    {0x0100c, 0x4, 1, "PS_TEMP_REGISTER_CONTROL"},
+    {0x01010, 0x4, 1, "PS_CONTROL"},
+    {0x01014, 0x4, 1, "PS_PERF_COUNTER"},
+    {0x01018, 0x4, 1, "PS_START_PC"},
+    {0x0101c, 0x4, 1, "PS_RANGE"},
+    {0x01200, 0x4, 1, "DE_SRC_ADDRESS"},
+    {0x01204, 0x4, 1, "DE_SRC_STRIDE"},
+    {0x01208, 0x4, 1, "DE_SRC_ROTATION_CONFIG"},
+    {0x0120c, 0x4, 1, "DE_SRC_CONFIG"},
+    {0x01210, 0x4, 1, "DE_SRC_ORIGIN"},
+    {0x01214, 0x4, 1, "DE_SRC_SIZE"},
+    {0x01218, 0x4, 1, "DE_SRC_COLOR_BG"},
+    {0x0121c, 0x4, 1, "DE_SRC_COLOR_FG"},
+    {0x01220, 0x4, 1, "DE_STRETCH_FACTOR_LOW"},
+    {0x01224, 0x4, 1, "DE_STRETCH_FACTOR_HIGH"},
+    {0x01228, 0x4, 1, "DE_DEST_ADDRESS"},
+    {0x0122c, 0x4, 1, "DE_DEST_STRIDE"},
+    {0x01230, 0x4, 1, "DE_DEST_ROTATION_CONFIG"},
+    {0x01234, 0x4, 1, "DE_DEST_CONFIG"},
+    {0x01238, 0x4, 1, "DE_PATTERN_ADDRESS"},
+    {0x0123c, 0x4, 1, "DE_PATTERN_CONFIG"},
+    {0x01240, 0x4, 1, "DE_PATTERN_LOW"},
+    {0x01244, 0x4, 1, "DE_PATTERN_HIGH"},
+    {0x01248, 0x4, 1, "DE_PATTERN_MASK_LOW"},
+    {0x0124c, 0x4, 1, "DE_PATTERN_MASK_HIGH"},
+    {0x01250, 0x4, 1, "DE_PATTERN_BG_COLOR"},
+    {0x01254, 0x4, 1, "DE_PATTERN_FG_COLOR"},
+    {0x0125c, 0x4, 1, "DE_ROP"},
+    {0x01260, 0x4, 1, "DE_CLIP_TOP_LEFT"},
+    {0x01264, 0x4, 1, "DE_CLIP_BOTTOM_RIGHT"},
+    {0x01268, 0x4, 1, "DE_CLEAR_BYTE_MASK"},
+    {0x0126c, 0x4, 1, "DE_CONFIG"},
+    {0x01270, 0x4, 1, "DE_CLEAR_PIXEL_VALUE_LOW"},
+    {0x01274, 0x4, 1, "DE_CLEAR_PIXEL_VALUE_HIGH"},
+    {0x01278, 0x4, 1, "DE_SRC_ORIGIN_FRACTION"},
+    {0x0127c, 0x4, 1, "DE_ALPHA_CONTROL"},
+    {0x01280, 0x4, 1, "DE_ALPHA_MODES"},
+    {0x01284, 0x4, 1, "DE_UPLANE_ADDRESS"},
+    {0x01288, 0x4, 1, "DE_UPLANE_STRIDE"},
+    {0x0128c, 0x4, 1, "DE_VPLANE_ADDRESS"},
+    {0x01290, 0x4, 1, "DE_VPLANE_STRIDE"},
+    {0x01294, 0x4, 1, "DE_VR_CONFIG"},
+    {0x01298, 0x4, 1, "DE_VR_SOURCE_IMAGE_LOW"},
+    {0x0129c, 0x4, 1, "DE_VR_SOURCE_IMAGE_HIGH"},
+    {0x012a0, 0x4, 1, "DE_VR_SOURCE_ORIGIN_LOW"},
+    {0x012a4, 0x4, 1, "DE_VR_SOURCE_ORIGIN_HIGH"},
+    {0x012a8, 0x4, 1, "DE_VR_TARGET_WINDOW_LOW"},
+    {0x012ac, 0x4, 1, "DE_VR_TARGET_WINDOW_HIGH"},
+    {0x012b0, 0x4, 1, "DE_PE_CONFIG"},
+    {0x012b4, 0x4, 1, "DE_DEST_ROTATION_HEIGHT"},
+    {0x012b8, 0x4, 1, "DE_SRC_ROTATION_HEIGHT"},
+    {0x012bc, 0x4, 1, "DE_ROT_ANGLE"},
+    {0x012c0, 0x4, 1, "DE_CLEAR_PIXEL_VALUE32"},
+    {0x012c4, 0x4, 1, "DE_DEST_COLOR_KEY"},
+    {0x012c8, 0x4, 1, "DE_GLOBAL_SRC_COLOR"},
+    {0x012cc, 0x4, 1, "DE_GLOBAL_DEST_COLOR"},
+    {0x012d0, 0x4, 1, "DE_COLOR_MULTIPLY_MODES"},
+    {0x012d4, 0x4, 1, "DE_PE_TRANSPARENCY"},
+    {0x012d8, 0x4, 1, "DE_PE_CONTROL"},
+    {0x012dc, 0x4, 1, "DE_SRC_COLOR_KEY_HIGH"},
+    {0x012e0, 0x4, 1, "DE_DEST_COLOR_KEY_HIGH"},
+    {0x012e4, 0x4, 1, "DE_VR_CONFIG_EX"},
+    {0x012e8, 0x4, 1, "DE_PE_DITHER_LOW"},
+    {0x012ec, 0x4, 1, "DE_PE_DITHER_HIGH"},
+    {0x012f0, 0x4, 1, "DE_BW_CONFIG"},
+    {0x012f4, 0x4, 1, "DE_BW_BLOCK_SIZE"},
+    {0x012f8, 0x4, 1, "DE_BW_TILE_SIZE"},
+    {0x012fc, 0x4, 1, "DE_BW_BLOCK_MASK"},
+    {0x01300, 0x4, 1, "DE_SRC_EX_CONFIG"},
+    {0x01304, 0x4, 1, "DE_SRC_EX_ADDRESS"},
+    {0x01308, 0x4, 1, "DE_DE_MULTI_SOURCE"},
+    {0x0130c, 0x4, 1, "DE_DEYUV_CONVERSION"},
+    {0x01310, 0x4, 1, "DE_DE_PLANE2_ADDRESS"},
+    {0x01314, 0x4, 1, "DE_DE_PLANE2_STRIDE"},
+    {0x01318, 0x4, 1, "DE_DE_PLANE3_ADDRESS"},
+    {0x0131c, 0x4, 1, "DE_DE_PLANE3_STRIDE"},
+    {0x01320, 0x4, 1, "DE_DE_STALL_DE"},
+    {0x01400, 0x4, 1, "PE_DEPTH_CONFIG"},
+    {0x01404, 0x4, 1, "PE_DEPTH_NEAR"},
+    {0x01408, 0x4, 1, "PE_DEPTH_FAR"},
+    {0x0140c, 0x4, 1, "PE_DEPTH_NORMALIZE"},
+    {0x01410, 0x4, 1, "PE_DEPTH_ADDR"},
+    {0x01414, 0x4, 1, "PE_DEPTH_STRIDE"},
+    {0x01418, 0x4, 1, "PE_STENCIL_OP"},
+    {0x0141c, 0x4, 1, "PE_STENCIL_CONFIG"},
+    {0x01420, 0x4, 1, "PE_ALPHA_OP"},
+    {0x01424, 0x4, 1, "PE_ALPHA_BLEND_COLOR"},
+    {0x01428, 0x4, 1, "PE_ALPHA_CONFIG"},
+    {0x0142c, 0x4, 1, "PE_COLOR_FORMAT"},
+    {0x01430, 0x4, 1, "PE_COLOR_ADDR"},
+    {0x01434, 0x4, 1, "PE_COLOR_STRIDE"},
+    {0x01454, 0x4, 1, "PE_HDEPTH_CONTROL"},
+    {0x01458, 0x4, 1, "PE_HDEPTH_ADDR"},
+    {0x0145c, 0x4, 1, "PE_UNK0145C"},
+    {0x01460, 0x4, 8, "PE_PIPE_COLOR_ADDR"},
+    {0x01480, 0x4, 8, "PE_PIPE_DEPTH_ADDR"},
+    {0x014a0, 0x4, 1, "PE_STENCIL_CONFIG_EXT"},
+    {0x014a4, 0x4, 1, "PE_LOGIC_OP"},
+    {0x014a8, 0x4, 2, "PE_DITHER"},
+    {0x014b0, 0x4, 1, "PE_UNK014B0"},
+    {0x014b4, 0x4, 1, "PE_UNK014B4"},
+    {0x01500, 0x4, 8, "PE_PIPE_ADDR_UNK01500"},
+    {0x01520, 0x4, 8, "PE_PIPE_ADDR_UNK01520"},
+    {0x01580, 0x4, 3, "PE_UNK01580"},
+    {0x01600, 0x4, 1, "RS_KICKER"},
+    {0x01604, 0x4, 1, "RS_CONFIG"},
+    {0x01608, 0x4, 1, "RS_SOURCE_ADDR"},
+    {0x0160c, 0x4, 1, "RS_SOURCE_STRIDE"},
+    {0x01610, 0x4, 1, "RS_DEST_ADDR"},
+    {0x01614, 0x4, 1, "RS_DEST_STRIDE"},
+    {0x01620, 0x4, 1, "RS_WINDOW_SIZE"},
+    {0x01630, 0x4, 2, "RS_DITHER"},
+    {0x0163c, 0x4, 1, "RS_CLEAR_CONTROL"},
+    {0x01640, 0x4, 4, "RS_FILL_VALUE"},
+    {0x01650, 0x4, 1, "TS_FLUSH_CACHE"},
+    {0x01654, 0x4, 1, "TS_MEM_CONFIG"},
+    {0x01658, 0x4, 1, "TS_COLOR_STATUS_BASE"},
+    {0x0165c, 0x4, 1, "TS_COLOR_SURFACE_BASE"},
+    {0x01660, 0x4, 1, "TS_COLOR_CLEAR_VALUE"},
+    {0x01664, 0x4, 1, "TS_DEPTH_STATUS_BASE"},
+    {0x01668, 0x4, 1, "TS_DEPTH_SURFACE_BASE"},
+    {0x0166c, 0x4, 1, "TS_DEPTH_CLEAR_VALUE"},
+    {0x01670, 0x4, 1, "TS_DEPTH_AUTO_DISABLE_COUNT"},
+    {0x01674, 0x4, 1, "TS_COLOR_AUTO_DISABLE_COUNT"},
+    {0x01678, 0x4, 1, "YUV_UNK01678"},
+    {0x0167c, 0x4, 1, "YUV_UNK0167C"},
+    {0x01680, 0x4, 1, "YUV_UNK01680"},
+    {0x01684, 0x4, 1, "YUV_UNK01684"},
+    {0x01688, 0x4, 1, "YUV_UNK01688"},
+    {0x0168c, 0x4, 1, "YUV_UNK0168C"},
+    {0x01690, 0x4, 1, "YUV_UNK01690"},
+    {0x01694, 0x4, 1, "YUV_UNK01694"},
+    {0x01698, 0x4, 1, "YUV_UNK01698"},
+    {0x0169c, 0x4, 1, "YUV_UNK0169C"},
+    {0x016a0, 0x4, 1, "RS_EXTRA_CONFIG"},
+    {0x016a4, 0x4, 1, "TS_HDEPTH_STATUS_BASE"},
+    {0x016a8, 0x4, 1, "TS_HDEPTH_CLEAR_VALUE"},
+    {0x016ac, 0x4, 1, "TS_HDEPTH_SIZE"},
+    {0x016b4, 0x4, 1, "RS_UNK016B4"},
+    {0x016c0, 0x4, 8, "RS_PIPE_SOURCE_ADDR"},
+    {0x016e0, 0x4, 8, "RS_PIPE_DEST_ADDR"},
+    {0x01700, 0x4, 8, "RS_PIPE_OFFSET"},
+    {0x01720, 0x4, 8, "TS_SAMPLER_CONFIG"},
+    {0x01740, 0x4, 8, "TS_SAMPLER_STATUS_BASE"},
+    {0x01760, 0x4, 8, "TS_SAMPLER_CLEAR_VALUE"},
+    {0x01800, 0x4, 128, "DE_FILTER_KERNEL"},
+    {0x01c00, 0x4, 256, "DE_INDEX_COLOR_TABLE"},
+    {0x02000, 0x4, 12, "TE_SAMPLER_CONFIG0"},
+    {0x02040, 0x4, 12, "TE_SAMPLER_SIZE"},
+    {0x02080, 0x4, 12, "TE_SAMPLER_LOG_SIZE"},
+    {0x020c0, 0x4, 12, "TE_SAMPLER_LOD_CONFIG"},
+    {0x02100, 0x4, 12, "TE_SAMPLER_UNK02100"},
+    {0x02140, 0x4, 12, "TE_SAMPLER_UNK02140"},
+    {0x02180, 0x4, 12, "TE_SAMPLER_UNK02180"},
+    {0x021c0, 0x4, 12, "TE_SAMPLER_CONFIG1"},
+    {0x02200, 0x4, 12, "TE_SAMPLER_UNK02200"},
+    {0x02240, 0x4, 12, "TE_SAMPLER_UNK02240"},
+    {0x02400, 0x4, 224, "TE_SAMPLER_LOD_ADDR"},
+    {0x02800, 0x4, 1, "VG_UNK02800"},
+    {0x02804, 0x4, 1, "VG_UNK02804"},
+    {0x02808, 0x4, 1, "VG_UNK02808"},
+    {0x0280c, 0x4, 1, "VG_UNK0280C"},
+    {0x02810, 0x4, 2, "VG_UNK02810"},
+    {0x02818, 0x4, 2, "VG_UNK02818"},
+    {0x02820, 0x4, 2, "VG_UNK02820"},
+    {0x02828, 0x4, 1, "VG_UNK02828"},
+    {0x0282c, 0x4, 1, "VG_UNK0282C"},
+    {0x02830, 0x4, 4, "VG_UNK02830"},
+    {0x02840, 0x4, 1, "VG_UNK02840"},
+    {0x02844, 0x4, 1, "VG_UNK02844"},
+    {0x02848, 0x4, 1, "VG_UNK02848"},
+    {0x0284c, 0x4, 1, "VG_UNK0284C"},
+    {0x02850, 0x4, 1, "VG_UNK02850"},
+    {0x02854, 0x4, 1, "VG_UNK02854"},
+    {0x02858, 0x4, 1, "VG_UNK02858"},
+    {0x0285c, 0x4, 1, "VG_UNK0285C"},
+    {0x02860, 0x4, 3, "VG_UNK02860"},
+    {0x02870, 0x4, 3, "VG_UNK02870"},
+    {0x02880, 0x4, 3, "VG_UNK02880"},
+    {0x02890, 0x4, 2, "VG_UNK02890"},
+    {0x02898, 0x4, 2, "VG_UNK02898"},
+    {0x028a0, 0x4, 2, "VG_UNK028A0"},
+    {0x028a8, 0x4, 2, "VG_UNK028A8"},
+    {0x028b0, 0x4, 2, "VG_UNK028B0"},
+    {0x028b8, 0x4, 2, "VG_UNK028B8"},
+    {0x028c0, 0x4, 1, "VG_UNK028C0"},
+    {0x028c4, 0x4, 1, "VG_UNK028C4"},
+    {0x028c8, 0x4, 1, "VG_UNK028C8"},
+    {0x028cc, 0x4, 1, "VG_UNK028CC"},
+    {0x028d0, 0x4, 1, "VG_UNK028D0"},
+    {0x028d4, 0x4, 1, "VG_UNK028D4"},
+    {0x028d8, 0x4, 1, "VG_UNK028D8"},
+    {0x028dc, 0x4, 1, "VG_UNK028DC"},
+    {0x028e0, 0x4, 1, "VG_UNK028E0"},
+    {0x028e4, 0x4, 1, "VG_UNK028E4"},
+    {0x028e8, 0x4, 1, "VG_UNK028E8"},
+    {0x028ec, 0x4, 1, "VG_UNK028EC"},
+    {0x028f0, 0x4, 1, "VG_UNK028F0"},
+    {0x028f8, 0x4, 1, "VG_UNK028F8"},
+    {0x028fc, 0x4, 1, "VG_UNK028FC"},
+    {0x02900, 0x4, 6, "VG_UNK02900"},
+    {0x02918, 0x4, 1, "VG_UNK02918"},
+    {0x0291c, 0x4, 1, "VG_UNK0291C"},
+    {0x02920, 0x4, 1, "VG_UNK02920"},
+    {0x02924, 0x4, 1, "VG_UNK02924"},
+    {0x02928, 0x4, 1, "VG_UNK02928"},
+    {0x0292c, 0x4, 1, "VG_UNK0292C"},
+    {0x02930, 0x4, 1, "VG_UNK02930"},
+    {0x02934, 0x4, 1, "VG_UNK02934"},
+    {0x02938, 0x4, 1, "VG_UNK02938"},
+    {0x0293c, 0x4, 1, "VG_UNK0293C"},
+    {0x02940, 0x4, 2, "VG_UNK02940"},
+    {0x02948, 0x4, 2, "VG_UNK02948"},
+    {0x02950, 0x4, 1, "VG_UNK02950"},
+    {0x02954, 0x4, 1, "VG_UNK02954"},
+    {0x02958, 0x4, 1, "VG_UNK02958"},
+    {0x0295c, 0x4, 1, "VG_UNK0295C"},
+    {0x02960, 0x4, 1, "VG_UNK02960"},
+    {0x02980, 0x4, 25, "VG_UNK02980"},
+    {0x02a00, 0x4, 128, "DE_VERTI_FILTER_KERNEL"},
+    {0x03008, 0x4, 1, "CO_UNK03008"},
+    {0x0300c, 0x4, 1, "CO_KICKER"},
+    {0x03010, 0x4, 1, "CO_UNK03010"},
+    {0x03014, 0x4, 1, "CO_UNK03014"},
+    {0x03018, 0x4, 1, "CO_UNK03018"},
+    {0x0301c, 0x4, 1, "CO_UNK0301C"},
+    {0x03020, 0x4, 1, "CO_UNK03020"},
+    {0x03024, 0x4, 1, "CO_UNK03024"},
+    {0x03040, 0x4, 1, "CO_UNK03040"},
+    {0x03044, 0x4, 1, "CO_UNK03044"},
+    {0x03048, 0x4, 1, "CO_UNK03048"},
+    {0x03060, 0x4, 8, "CO_SAMPLER_UNK03060"},
+    {0x03080, 0x4, 8, "CO_SAMPLER_UNK03080"},
+    {0x030a0, 0x4, 8, "CO_SAMPLER_UNK030A0"},
+    {0x030c0, 0x4, 8, "CO_SAMPLER_UNK030C0"},
+    {0x030e0, 0x4, 8, "CO_SAMPLER_UNK030E0"},
+    {0x03100, 0x4, 8, "CO_SAMPLER_UNK03100"},
+    {0x03120, 0x4, 8, "CO_SAMPLER_UNK03120"},
+    {0x03140, 0x4, 8, "CO_SAMPLER_UNK03140"},
+    {0x03160, 0x4, 8, "CO_SAMPLER_UNK03160"},
+    {0x03180, 0x4, 8, "CO_SAMPLER_UNK03180"},
+    {0x031a0, 0x4, 8, "CO_SAMPLER_UNK031A0"},
+    {0x031c0, 0x4, 8, "CO_SAMPLER_UNK031C0"},
+    {0x031e0, 0x4, 8, "CO_SAMPLER_UNK031E0"},
+    {0x03200, 0x4, 64, "CO_ADDR_UNK03200_PPIPE"},
+    {0x03400, 0x4, 256, "DE_INDEX_COLOR_TABLE32"},
+    {0x03800, 0x4, 1, "GL_PIPE_SELECT"},
+    {0x03804, 0x4, 1, "GL_EVENT"},
+    {0x03808, 0x4, 1, "GL_SEMAPHORE_TOKEN"},
+    {0x0380c, 0x4, 1, "GL_FLUSH_CACHE"},
+    {0x03810, 0x4, 1, "GL_FLUSH_MMU"},
+    {0x03814, 0x4, 1, "GL_VERTEX_ELEMENT_CONFIG"},
+    {0x03818, 0x4, 1, "GL_MULTI_SAMPLE_CONFIG"},
+    {0x0381c, 0x4, 1, "GL_VARYING_TOTAL_COMPONENTS"},
+    {0x03820, 0x4, 1, "GL_VARYING_NUM_COMPONENTS"},
+    {0x03828, 0x4, 2, "GL_VARYING_COMPONENT_USE"},
+    {0x03834, 0x4, 1, "GL_UNK03834"},
+    {0x03838, 0x4, 1, "GL_UNK03838"},
+    {0x0384c, 0x4, 1, "GL_API_MODE"},
+    {0x03850, 0x4, 1, "GL_CONTEXT_POINTER"},
+    {0x03a00, 0x4, 1, "GL_UNK03A00"},
+    {0x03c00, 0x4, 1, "GL_STALL_TOKEN"},
+    {0x04000, 0x4, 1024, "VS_INST_MEM"},
+    {0x05000, 0x4, 1024, "VS_UNIFORMS"},
+    {0x06000, 0x4, 1024, "PS_INST_MEM"},
+    {0x07000, 0x4, 1024, "PS_UNIFORMS"},
+    {0x08000, 0x4, 4096, "SH_UNK0C000_MIRROR"},
+    {0x0c000, 0x4, 4096, "SH_INST_MEM"},
+    {0x10000, 0x4, 32, "NTE_SAMPLER_CONFIG0"},
+    {0x10080, 0x4, 32, "NTE_SAMPLER_SIZE"},
+    {0x10100, 0x4, 32, "NTE_SAMPLER_LOG_SIZE"},
+    {0x10180, 0x4, 32, "NTE_SAMPLER_LOD_CONFIG"},
+    {0x10200, 0x4, 32, "NTE_SAMPLER_UNK10200"},
+    {0x10280, 0x4, 32, "NTE_SAMPLER_UNK10280"},
+    {0x10300, 0x4, 32, "NTE_SAMPLER_UNK10300"},
+    {0x10380, 0x4, 32, "NTE_SAMPLER_CONFIG1"},
+    {0x10400, 0x4, 32, "NTE_SAMPLER_UNK10400"},
+    {0x10480, 0x4, 32, "NTE_SAMPLER_UNK10480"},
+    {0x10800, 0x4, 512, "NTE_SAMPLER_ADDR_LOD"},
+    {0x12000, 0x4, 256, "NTE_UNK12000"},
+    {0x12400, 0x4, 256, "NTE_UNK12400"},
+    {0x12800, 0x4, 4, "DE_BLOCK4_SRC_ADDRESS"},
+    {0x12810, 0x4, 4, "DE_BLOCK4_SRC_STRIDE"},
+    {0x12820, 0x4, 4, "DE_BLOCK4_SRC_ROTATION_CONFIG"},
+    {0x12830, 0x4, 4, "DE_BLOCK4_SRC_CONFIG"},
+    {0x12840, 0x4, 4, "DE_BLOCK4_SRC_ORIGIN"},
+    {0x12850, 0x4, 4, "DE_BLOCK4_SRC_SIZE"},
+    {0x12860, 0x4, 4, "DE_BLOCK4_SRC_COLOR_BG"},
+    {0x12870, 0x4, 4, "DE_BLOCK4_ROP"},
+    {0x12880, 0x4, 4, "DE_BLOCK4_ALPHA_CONTROL"},
+    {0x12890, 0x4, 4, "DE_BLOCK4_ALPHA_MODES"},
+    {0x128a0, 0x4, 4, "DE_BLOCK4_ADDRESS_U"},
+    {0x128b0, 0x4, 4, "DE_BLOCK4_STRIDE_U"},
+    {0x128c0, 0x4, 4, "DE_BLOCK4_ADDRESS_V"},
+    {0x128d0, 0x4, 4, "DE_BLOCK4_STRIDE_V"},
+    {0x128e0, 0x4, 4, "DE_BLOCK4_SRC_ROTATION_HEIGHT"},
+    {0x128f0, 0x4, 4, "DE_BLOCK4_ROT_ANGLE"},
+    {0x12900, 0x4, 4, "DE_BLOCK4_GLOBAL_SRC_COLOR"},
+    {0x12910, 0x4, 4, "DE_BLOCK4_GLOBAL_DEST_COLOR"},
+    {0x12920, 0x4, 4, "DE_BLOCK4_COLOR_MULTIPLY_MODES"},
+    {0x12930, 0x4, 4, "DE_BLOCK4_TRANSPARENCY"},
+    {0x12940, 0x4, 4, "DE_BLOCK4_CONTROL"},
+    {0x12950, 0x4, 4, "DE_BLOCK4_SRC_COLOR_KEY_HIGH"},
+    {0x12960, 0x4, 4, "DE_BLOCK4_SRC_EX_CONFIG"},
+    {0x12970, 0x4, 4, "DE_BLOCK4_SRC_EX_ADDRESS"},
+    {0x12a00, 0x4, 8, "DE_BLOCK8_SRC_ADDRESS"},
+    {0x12a20, 0x4, 8, "DE_BLOCK8_SRC_STRIDE"},
+    {0x12a40, 0x4, 8, "DE_BLOCK8_SRC_ROTATION_CONFIG"},
+    {0x12a60, 0x4, 8, "DE_BLOCK8_SRC_CONFIG"},
+    {0x12a80, 0x4, 8, "DE_BLOCK8_SRC_ORIGIN"},
+    {0x12aa0, 0x4, 8, "DE_BLOCK8_SRC_SIZE"},
+    {0x12ac0, 0x4, 8, "DE_BLOCK8_SRC_COLOR_BG"},
+    {0x12ae0, 0x4, 8, "DE_BLOCK8_ROP"},
+    {0x12b00, 0x4, 8, "DE_BLOCK8_ALPHA_CONTROL"},
+    {0x12b20, 0x4, 8, "DE_BLOCK8_ALPHA_MODES"},
+    {0x12b40, 0x4, 8, "DE_BLOCK8_ADDRESS_U"},
+    {0x12b60, 0x4, 8, "DE_BLOCK8_STRIDE_U"},
+    {0x12b80, 0x4, 8, "DE_BLOCK8_ADDRESS_V"},
+    {0x12ba0, 0x4, 8, "DE_BLOCK8_STRIDE_V"},
+    {0x12bc0, 0x4, 8, "DE_BLOCK8_SRC_ROTATION_HEIGHT"},
+    {0x12be0, 0x4, 8, "DE_BLOCK8_ROT_ANGLE"},
+    {0x12c00, 0x4, 8, "DE_BLOCK8_GLOBAL_SRC_COLOR"},
+    {0x12c20, 0x4, 8, "DE_BLOCK8_GLOBAL_DEST_COLOR"},
+    {0x12c40, 0x4, 8, "DE_BLOCK8_COLOR_MULTIPLY_MODES"},
+    {0x12c60, 0x4, 8, "DE_BLOCK8_TRANSPARENCY"},
+    {0x12c80, 0x4, 8, "DE_BLOCK8_CONTROL"},
+    {0x12ca0, 0x4, 8, "DE_BLOCK8_SRC_COLOR_KEY_HIGH"},
+    {0x12cc0, 0x4, 8, "DE_BLOCK8_SRC_EX_CONFIG"},
+    {0x12ce0, 0x4, 8, "DE_BLOCK8_SRC_EX_ADDRESS"},
+    {0x20000, 0x4, 8192, "SH_UNK20000"},
+    {0x3fffc, 0x4, 1, "DUMMY_DUMMY"},
+};
+
+#endif
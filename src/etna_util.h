@@ -28,12 +28,21 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 
 #define ETNA_MALLOC(_size) malloc(_size)
 #define ETNA_CALLOC_STRUCT(T)   (struct T *) calloc(1, sizeof(struct T))
 #define ETNA_CALLOC_STRUCT_ARRAY(N, T)   (struct T *) calloc((N), sizeof(struct T))
 #define ETNA_FREE(_ptr) free(_ptr)
 
+/* monotonic time in nanoseconds */
+static inline uint64_t etna_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 /* align to a value divisable by granularity >= value, works only for powers of two */
 static inline uint32_t etna_align_up(uint32_t value, uint32_t granularity)
 {
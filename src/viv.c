@@ -21,6 +21,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 #include <viv.h>
+#include <viv_capture.h>
 #include <etna_util.h>
 
 #include <unistd.h>
@@ -35,6 +36,9 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
+#include <time.h>
 
 #include "gc_abi.h"
 #include "viv_internal.h"
@@ -81,50 +85,193 @@ struct viv_membuf_map {
 };
 #define IOC_GMEMBUF_MAP _IOWR('_', 1, struct viv_membuf_map)
 
+/* Time slice for blocking fence waits, after which the fence is re-checked */
+#define VIV_FENCE_STALL_SLICE_MS 10
+
 const char *galcore_device[] = {"/dev/gal3d", "/dev/galcore", "/dev/graphics/galcore", NULL};
 #define INTERFACE_SIZE (sizeof(gcsHAL_INTERFACE))
 
-/* Allocate signals for fences */
-static int viv_allocate_signals(struct viv_conn *conn)
+/* Create count signals for the fence table */
+static int viv_create_fence_signals(struct viv_conn *conn, int *signals, uint32_t count)
 {
     int rv;
-    if(pthread_mutex_init(&conn->fence_mutex, NULL))
-        return VIV_STATUS_OUT_OF_MEMORY;
-    for(int x=0; x<VIV_NUM_FENCE_SIGNALS; ++x)
+    for(uint32_t x=0; x<count; ++x)
     {
-        /* Create signal with manual reset; we want to be able to probe it
-         * or wait for it without resetting it.
+        /* Create signal with automatic reset: a successful wait or poll
+         * resets it, so the result of a poll must be recorded in the fence
+         * table (see viv_fence_retire) rather than polled again.
          */
-        if((rv = viv_user_signal_create(conn, /* manualReset */ false, &conn->fence_signals[x])) != VIV_STATUS_OK)
+        if((rv = viv_user_signal_create(conn, /* manualReset */ false, &signals[x])) != VIV_STATUS_OK)
         {
+            while(x-- > 0)
+                (void) viv_user_signal_destroy(conn, signals[x]);
             return rv;
         }
     }
+    return VIV_STATUS_OK;
+}
+
+static struct viv_fence_table *viv_fence_table_new(uint32_t num)
+{
+    struct viv_fence_table *table = calloc(1, sizeof(struct viv_fence_table) + num * sizeof(struct viv_fence_slot));
+    if(table != NULL)
+        table->num = num;
+    return table;
+}
+
+/* Allocate signals for fences */
+static int viv_allocate_signals(struct viv_conn *conn)
+{
+    int signals[VIV_NUM_FENCE_SIGNALS];
+    struct viv_fence_table *table;
+    int rv;
+    if(pthread_mutex_init(&conn->fence_mutex, NULL))
+        return VIV_STATUS_OUT_OF_MEMORY;
+    if((table = viv_fence_table_new(VIV_NUM_FENCE_SIGNALS)) == NULL)
+        return VIV_STATUS_OUT_OF_MEMORY;
+    if((rv = viv_create_fence_signals(conn, signals, VIV_NUM_FENCE_SIGNALS)) != VIV_STATUS_OK)
+    {
+        free(table);
+        return rv;
+    }
+    for(uint32_t x=0; x<VIV_NUM_FENCE_SIGNALS; ++x)
+    {
+        table->slots[x].fence = x - VIV_NUM_FENCE_SIGNALS; /* not dealt yet */
+        table->slots[x].state = VIV_FENCE_RETIRED;
+        table->slots[x].signal = signals[x];
+    }
+    conn->fences = table;
     conn->next_fence_id = 0;
     conn->last_fence_id = -1; /* far enough into the past */
+    conn->fence_alloc_stalls = 0;
     return VIV_STATUS_OK;
 }
 
 /* Free signals for fences */
 static int viv_deallocate_signals(struct viv_conn *conn)
 {
+    struct viv_fence_table *table = conn->fences;
     int rv;
-    for(int x=0; x<VIV_NUM_FENCE_SIGNALS; ++x)
+    for(uint32_t x=0; x<table->num; ++x)
     {
-        if((rv = viv_user_signal_destroy(conn, conn->fence_signals[x])) != VIV_STATUS_OK)
+        if((rv = viv_user_signal_destroy(conn, table->slots[x].signal)) != VIV_STATUS_OK)
             return rv;
     }
+    while(table != NULL)
+    {
+        struct viv_fence_table *prev = table->prev;
+        free(table);
+        table = prev;
+    }
+    conn->fences = NULL;
     if(pthread_mutex_destroy(&conn->fence_mutex))
         return VIV_STATUS_OUT_OF_MEMORY;
     return VIV_STATUS_OK;
 }
 
-/* Get signal id # for a fence */
-static int signal_for_fence(struct viv_conn *conn, uint32_t fence)
+/* Double the size of the fence table.
+ * The slots in use belong to the last num fences dealt. These are
+ * consecutive, so they map to distinct slots of the larger table as well;
+ * every slot moves to the position of its fence, keeping its signal and
+ * state. The other positions get new signals.
+ * @note must be called with fence_mutex held
+ */
+static int viv_grow_fences(struct viv_conn *conn)
+{
+    struct viv_fence_table *old = conn->fences;
+    uint32_t num = old->num * 2;
+    uint32_t base = conn->next_fence_id - old->num; /* oldest fence in use */
+    struct viv_fence_table *table;
+    int *signals;
+    int rv;
+    if(num > VIV_MAX_FENCE_SIGNALS)
+        return VIV_STATUS_OUT_OF_MEMORY;
+    table = viv_fence_table_new(num);
+    signals = malloc((num - old->num) * sizeof(int));
+    if(table == NULL || signals == NULL)
+    {
+        rv = VIV_STATUS_OUT_OF_MEMORY;
+        goto error;
+    }
+    if((rv = viv_create_fence_signals(conn, signals, num - old->num)) != VIV_STATUS_OK)
+        goto error;
+    for(uint32_t x=0, y=0; x<num; ++x)
+    {
+        struct viv_fence_slot *slot = &table->slots[x];
+        uint32_t delta = (x - base) & (num - 1);
+        uint32_t fence = base + delta; /* next fence to use position x */
+        if(delta < old->num)
+        {
+            *slot = old->slots[fence & (old->num - 1)];
+            if(slot->fence == fence)
+                continue;
+        } else {
+            slot->signal = signals[y++];
+        }
+        slot->fence = fence - num; /* not dealt yet */
+        slot->state = VIV_FENCE_RETIRED;
+    }
+    free(signals);
+    /* Readers without the mutex may still look at the old table */
+    table->prev = old;
+    __atomic_store_n(&conn->fences, table, __ATOMIC_RELEASE);
+#ifdef FENCE_DEBUG
+    fprintf(stderr, "Fence table grown to %u entries\n", num);
+#endif
+    return VIV_STATUS_OK;
+error:
+    free(signals);
+    free(table);
+    return rv;
+}
+
+static void viv_notifier_retired(struct viv_notifier *notifier, struct viv_conn *conn);
+
+/* Move last_fence_id forward to fence, unless it is past it already.
+ * Can be called without fence_mutex.
+ */
+static void viv_fence_retire(struct viv_conn *conn, uint32_t fence)
+{
+    uint32_t last = __atomic_load_n(&conn->last_fence_id, __ATOMIC_RELAXED);
+    while(VIV_FENCE_BEFORE(last, fence))
+    {
+        if(__atomic_compare_exchange_n(&conn->last_fence_id, &last, fence, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+            /* a poll may have taken the signal the notifier waits for */
+            if(conn->notifier != NULL)
+                viv_notifier_retired(conn->notifier, conn);
+            break;
+        }
+    }
+#ifdef FENCE_DEBUG
+    fprintf(stderr, "Last fence id updated to %08x\n", fence);
+#endif
+}
+
+/* Get state of a fence, and its signal if pending, without fence_mutex.
+ * A fence before the last signalled one, too old to be in the table, or
+ * never dealt counts as retired.
+ */
+static uint32_t viv_fence_peek(struct viv_conn *conn, uint32_t fence, int *signal_out)
 {
-    if((conn->next_fence_id - fence) >= VIV_NUM_FENCE_SIGNALS)
-        return -1; /* too old */
-    return conn->fence_signals[fence % VIV_NUM_FENCE_SIGNALS];
+    if(VIV_FENCE_BEFORE_EQ(fence, __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE)))
+        return VIV_FENCE_RETIRED;
+    /* the table is published before next_fence_id moves past the fences in it */
+    uint32_t next = __atomic_load_n(&conn->next_fence_id, __ATOMIC_ACQUIRE);
+    struct viv_fence_table *table = __atomic_load_n(&conn->fences, __ATOMIC_ACQUIRE);
+    uint32_t age = next - fence;
+    if(age == 0 || age > table->num)
+        return VIV_FENCE_RETIRED;
+    struct viv_fence_slot *slot = &table->slots[fence & (table->num - 1)];
+    /* if the slot is handed to another fence meanwhile, this fence is done */
+    if(__atomic_load_n(&slot->fence, __ATOMIC_ACQUIRE) != fence)
+        return VIV_FENCE_RETIRED;
+    uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+    *signal_out = slot->signal;
+    if(__atomic_load_n(&slot->fence, __ATOMIC_RELAXED) != fence)
+        return VIV_FENCE_RETIRED;
+    return state;
 }
 
 /* Almost raw ioctl interface.  This provides an interface similar to
@@ -184,6 +331,11 @@ int viv_close(struct viv_conn *conn)
     if(conn->fd < 0)
         return -1;
 
+    (void) viv_async_stop(conn);
+    (void) viv_notifier_stop(conn);
+    (void) viv_capture_stop(conn);
+    pthread_mutex_destroy(&conn->capture_mutex);
+
     (void) viv_deallocate_signals(conn);
 
     munmap(conn->mem, conn->mem_length);
@@ -323,6 +475,15 @@ int viv_open(enum viv_hw_type hw_type, struct viv_conn **out)
     if((err=viv_allocate_signals(conn)) != VIV_STATUS_OK)
         goto error;
 
+    if(pthread_mutex_init(&conn->capture_mutex, NULL))
+    {
+        err = VIV_STATUS_OUT_OF_MEMORY;
+        goto error;
+    }
+    char *capture_out = getenv("ETNAVIV_CAPTURE");
+    if(capture_out)
+        (void) viv_capture_start(conn, capture_out);
+
     *out = conn;
     return gcvSTATUS_OK;
 error:
@@ -448,6 +609,7 @@ int viv_commit(struct viv_conn *conn, struct _gcoCMDBUF *commandBuffer, viv_cont
             }
         }
     };
+    _viv_capture_commit(conn, commandBuffer, (void*)(size_t)contextBuffer);
     if((rv=viv_invoke(conn, &id)) != gcvSTATUS_OK)
         return rv;
     /* commit queue after command buffer */
@@ -472,6 +634,8 @@ int viv_commit(struct viv_conn *conn, struct _gcoCMDBUF *commandBuffer, viv_cont
             }
         }
     };
+    _viv_capture_commit(conn, commandBuffer, NULL);
+    _viv_capture_events(conn, queue);
 
     return viv_invoke(conn, &id);
 }
@@ -487,9 +651,236 @@ int viv_event_commit(struct viv_conn *conn, struct _gcsQUEUE *queue)
             }
         }
     };
+    _viv_capture_events(conn, queue);
     return viv_invoke(conn, &id);
 }
 
+/* Asynchronous submission.
+ * Single-producer single-consumer ring of commits. The producer (holding
+ * fence_mutex) fills entry at head, the submission thread consumes at tail.
+ * The semaphores only put either side to sleep when the ring is
+ * empty or full.
+ */
+struct viv_async_entry {
+    bool quit; /* stop thread after this entry */
+    bool has_cmdbuf;
+    struct _gcoCMDBUF cmdbuf;
+    viv_context_t context;
+    /* copy of event queue, relinked */
+    struct _gcsQUEUE *queue;
+    int queue_count;
+    int queue_capacity;
+};
+
+struct viv_async {
+    pthread_t thread;
+    struct viv_async_entry ring[VIV_ASYNC_RING_SIZE];
+    uint32_t head; /* written by producer only */
+    uint32_t tail; /* written by submission thread only */
+    sem_t items; /* number of filled entries */
+    sem_t slots; /* number of free entries */
+    int error; /* first error returned by a commit, until reported */
+    /* for viv_async_drain */
+    pthread_mutex_t drain_mutex;
+    pthread_cond_t drain_cond;
+};
+
+/* Set the signals a failed commit would have had the kernel set, so that
+ * nobody waits forever for its fences or command buffers */
+static void viv_async_fail_signals(struct viv_conn *conn, struct _gcsQUEUE *queue)
+{
+    for(struct _gcsQUEUE *q = queue; q != NULL; q = VIV_TO_PTR(q->next))
+    {
+        if(q->iface.command == gcvHAL_SIGNAL)
+            viv_user_signal_signal(conn, (int)(intptr_t)VIV_TO_PTR(q->iface.u.Signal.signal), 1);
+    }
+}
+
+#ifndef GCABI_HAS_CONTEXT
+static void *viv_async_thread(void *data)
+{
+    struct viv_conn *conn = data;
+    struct viv_async *async = conn->async;
+    while(true)
+    {
+        while(sem_wait(&async->items) != 0)
+            ; /* EINTR */
+        uint32_t tail = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+        struct viv_async_entry *entry = &async->ring[tail % VIV_ASYNC_RING_SIZE];
+        bool quit = entry->quit;
+        int rv = VIV_STATUS_OK;
+        if(!quit)
+        {
+            struct _gcsQUEUE *queue = entry->queue_count ? entry->queue : NULL;
+            if(entry->has_cmdbuf)
+                rv = viv_commit(conn, &entry->cmdbuf, entry->context, queue);
+            else if(queue != NULL)
+                rv = viv_event_commit(conn, queue);
+            if(rv != VIV_STATUS_OK)
+            {
+                fprintf(stderr, "%s: asynchronous commit failed: %i\n", __func__, rv);
+                viv_async_fail_signals(conn, queue);
+                __atomic_compare_exchange_n(&async->error, &(int){VIV_STATUS_OK}, rv, false,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            }
+        }
+        __atomic_store_n(&async->tail, tail + 1, __ATOMIC_RELEASE);
+        sem_post(&async->slots);
+        if(__atomic_load_n(&async->head, __ATOMIC_ACQUIRE) == tail + 1)
+        {
+            pthread_mutex_lock(&async->drain_mutex);
+            pthread_cond_broadcast(&async->drain_cond);
+            pthread_mutex_unlock(&async->drain_mutex);
+        }
+        if(quit)
+            break;
+    }
+    return NULL;
+}
+#endif
+
+int viv_async_start(struct viv_conn *conn)
+{
+#ifdef GCABI_HAS_CONTEXT
+    return VIV_STATUS_NOT_SUPPORTED;
+#else
+    int rv = VIV_STATUS_OK;
+    /* Several contexts on this connection may start it at the same time */
+    pthread_mutex_lock(&conn->fence_mutex);
+    if(conn->async != NULL)
+        goto unlock_and_return;
+    struct viv_async *async = ETNA_CALLOC_STRUCT(viv_async);
+    if(async == NULL)
+    {
+        rv = VIV_STATUS_OUT_OF_MEMORY;
+        goto unlock_and_return;
+    }
+    if(sem_init(&async->items, 0, 0) != 0 ||
+       sem_init(&async->slots, 0, VIV_ASYNC_RING_SIZE) != 0 ||
+       pthread_mutex_init(&async->drain_mutex, NULL) != 0 ||
+       pthread_cond_init(&async->drain_cond, NULL) != 0)
+    {
+        ETNA_FREE(async);
+        rv = VIV_STATUS_OUT_OF_RESOURCES;
+        goto unlock_and_return;
+    }
+    /* Published before the thread starts, as it reads it from conn; readers
+     * that don't hold fence_mutex load it with acquire */
+    __atomic_store_n(&conn->async, async, __ATOMIC_RELEASE);
+    if(pthread_create(&async->thread, NULL, viv_async_thread, conn) != 0)
+    {
+        __atomic_store_n(&conn->async, NULL, __ATOMIC_RELEASE);
+        ETNA_FREE(async);
+        rv = VIV_STATUS_OUT_OF_RESOURCES;
+    }
+unlock_and_return:
+    pthread_mutex_unlock(&conn->fence_mutex);
+    return rv;
+#endif
+}
+
+/* Claim the entry at head, blocking while the ring is full */
+static struct viv_async_entry *viv_async_claim(struct viv_async *async)
+{
+    while(sem_wait(&async->slots) != 0)
+        ; /* EINTR */
+    return &async->ring[async->head % VIV_ASYNC_RING_SIZE];
+}
+
+/* Publish the entry at head to the submission thread */
+static void viv_async_publish(struct viv_async *async)
+{
+    __atomic_store_n(&async->head, async->head + 1, __ATOMIC_RELEASE);
+    sem_post(&async->items);
+}
+
+int viv_async_stop(struct viv_conn *conn)
+{
+    struct viv_async *async = conn->async;
+    int rv;
+    if(async == NULL)
+        return VIV_STATUS_OK;
+    pthread_mutex_lock(&conn->fence_mutex);
+    viv_async_claim(async)->quit = true;
+    viv_async_publish(async);
+    pthread_mutex_unlock(&conn->fence_mutex);
+    pthread_join(async->thread, NULL);
+
+    rv = async->error;
+    for(int x=0; x<VIV_ASYNC_RING_SIZE; ++x)
+        ETNA_FREE(async->ring[x].queue);
+    sem_destroy(&async->items);
+    sem_destroy(&async->slots);
+    pthread_mutex_destroy(&async->drain_mutex);
+    pthread_cond_destroy(&async->drain_cond);
+    __atomic_store_n(&conn->async, NULL, __ATOMIC_RELEASE);
+    ETNA_FREE(async);
+    return rv;
+}
+
+int viv_commit_async(struct viv_conn *conn, struct _gcoCMDBUF *commandBuffer, viv_context_t context, struct _gcsQUEUE *queue)
+{
+    struct viv_async *async = conn->async;
+    int rv;
+    if(async == NULL)
+        return VIV_STATUS_INVALID_REQUEST;
+    /* Report an earlier failure instead of queueing more work behind it;
+     * this commit then fails like the earlier one */
+    if((rv = __atomic_exchange_n(&async->error, VIV_STATUS_OK, __ATOMIC_RELAXED)) != VIV_STATUS_OK)
+    {
+        viv_async_fail_signals(conn, queue);
+        return rv;
+    }
+    struct viv_async_entry *entry = viv_async_claim(async);
+    entry->quit = false;
+    entry->has_cmdbuf = (commandBuffer != NULL);
+    if(commandBuffer != NULL)
+        entry->cmdbuf = *commandBuffer;
+    entry->context = context;
+    /* Copy event queue into entry, and relink it */
+    entry->queue_count = 0;
+    for(struct _gcsQUEUE *q = queue; q != NULL; q = VIV_TO_PTR(q->next))
+    {
+        if(entry->queue_count == entry->queue_capacity)
+        {
+            int capacity = entry->queue_capacity ? entry->queue_capacity * 2 : 16;
+            struct _gcsQUEUE *copy = realloc(entry->queue, capacity * sizeof(struct _gcsQUEUE));
+            if(copy == NULL)
+            {
+                sem_post(&async->slots); /* give back entry */
+                return VIV_STATUS_OUT_OF_MEMORY;
+            }
+            entry->queue = copy;
+            entry->queue_capacity = capacity;
+        }
+        entry->queue[entry->queue_count++] = *q;
+    }
+    for(int x=0; x<entry->queue_count; ++x)
+        entry->queue[x].next = PTR_TO_VIV((x + 1) < entry->queue_count ? &entry->queue[x + 1] : NULL);
+    viv_async_publish(async);
+    return VIV_STATUS_OK;
+}
+
+void _viv_async_wait(struct viv_conn *conn)
+{
+    struct viv_async *async = __atomic_load_n(&conn->async, __ATOMIC_ACQUIRE);
+    if(async == NULL)
+        return;
+    pthread_mutex_lock(&async->drain_mutex);
+    while(__atomic_load_n(&async->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&async->head, __ATOMIC_ACQUIRE))
+        pthread_cond_wait(&async->drain_cond, &async->drain_mutex);
+    pthread_mutex_unlock(&async->drain_mutex);
+}
+
+int viv_async_drain(struct viv_conn *conn)
+{
+    struct viv_async *async = __atomic_load_n(&conn->async, __ATOMIC_ACQUIRE);
+    if(async == NULL)
+        return VIV_STATUS_OK;
+    _viv_async_wait(conn);
+    return __atomic_exchange_n(&async->error, VIV_STATUS_OK, __ATOMIC_RELAXED);
+}
+
 int viv_user_signal_create(struct viv_conn *conn, int manualReset, int *id_out)
 {
     gcsHAL_INTERFACE id = {
@@ -713,99 +1104,352 @@ int viv_write_register(struct viv_conn *conn, uint32_t address, uint32_t data)
     return viv_invoke(conn, &id);
 }
 
+/* Completion notifier.
+ * A thread that waits for the signal of the oldest pending fence, retires it,
+ * and reports this by writing to an eventfd and waking up waiters. While it
+ * runs, blocking waits in viv_fence_finish wait for it instead of for the
+ * signals themselves, as a signal wakes up only one waiter.
+ */
+struct viv_notifier {
+    pthread_t thread;
+    int fd; /* eventfd */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; /* fence retired, fence pending, or quit */
+    bool kicked; /* a fence became pending */
+    bool quit;
+    uint32_t reported; /* last fence id written to the eventfd */
+    int error; /* error that stopped the thread */
+};
+
+/* Report retirements since the last report, also those by other waiters.
+ * @note must be called with notifier->mutex held
+ */
+static void viv_notifier_report(struct viv_notifier *notifier, struct viv_conn *conn)
+{
+    uint32_t last = __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE);
+    uint64_t one = 1;
+    if(last == notifier->reported)
+        return;
+    notifier->reported = last;
+    if(write(notifier->fd, &one, sizeof(one)) != sizeof(one))
+    {
+        /* counter full, so the eventfd is readable anyway */
+    }
+    pthread_cond_broadcast(&notifier->cond);
+}
+
+/* Report a fence retired outside of the notifier thread */
+static void viv_notifier_retired(struct viv_notifier *notifier, struct viv_conn *conn)
+{
+    pthread_mutex_lock(&notifier->mutex);
+    viv_notifier_report(notifier, conn);
+    pthread_mutex_unlock(&notifier->mutex);
+}
+
+static void *viv_notifier_thread(void *data)
+{
+    struct viv_conn *conn = data;
+    struct viv_notifier *notifier = conn->notifier;
+    int rv = VIV_STATUS_OK;
+    while(true)
+    {
+        /* Find the oldest pending fence. Fences that never became pending
+         * (failed commits) are retired along with a later one. */
+        uint32_t last = __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE);
+        uint32_t next = __atomic_load_n(&conn->next_fence_id, __ATOMIC_ACQUIRE);
+        uint32_t fence = last + 1;
+        int signal = -1;
+        for(; fence != next; ++fence)
+        {
+            if(viv_fence_peek(conn, fence, &signal) == VIV_FENCE_PENDING)
+                break;
+        }
+        if(fence != next)
+        {
+            rv = viv_user_signal_wait(conn, signal, VIV_FENCE_STALL_SLICE_MS);
+            if(rv == VIV_STATUS_OK)
+                viv_fence_retire(conn, fence);
+            else if(rv != VIV_STATUS_TIMEOUT)
+                break;
+            rv = VIV_STATUS_OK;
+        }
+        pthread_mutex_lock(&notifier->mutex);
+        viv_notifier_report(notifier, conn);
+        /* sleep until a fence becomes pending if there is none */
+        while(fence == next && !notifier->kicked && !notifier->quit)
+            pthread_cond_wait(&notifier->cond, &notifier->mutex);
+        notifier->kicked = false;
+        if(notifier->quit)
+        {
+            pthread_mutex_unlock(&notifier->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&notifier->mutex);
+    }
+    pthread_mutex_lock(&notifier->mutex);
+    notifier->error = rv;
+    pthread_cond_broadcast(&notifier->cond);
+    pthread_mutex_unlock(&notifier->mutex);
+    return NULL;
+}
+
+/* Wake up the notifier, as a fence became pending */
+static void viv_notifier_kick(struct viv_notifier *notifier)
+{
+    pthread_mutex_lock(&notifier->mutex);
+    notifier->kicked = true;
+    pthread_cond_broadcast(&notifier->cond);
+    pthread_mutex_unlock(&notifier->mutex);
+}
+
+/* Wait for the notifier to retire fence */
+static int viv_notifier_wait(struct viv_conn *conn, uint32_t fence, uint32_t timeout)
+{
+    struct viv_notifier *notifier = conn->notifier;
+    struct timespec deadline;
+    int rv = VIV_STATUS_OK;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&notifier->mutex);
+    while(!VIV_FENCE_BEFORE_EQ(fence, __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE)))
+    {
+        if(notifier->error != VIV_STATUS_OK)
+        {
+            rv = notifier->error;
+            break;
+        }
+        if(timeout == VIV_WAIT_INDEFINITE)
+            pthread_cond_wait(&notifier->cond, &notifier->mutex);
+        else if(pthread_cond_timedwait(&notifier->cond, &notifier->mutex, &deadline) == ETIMEDOUT)
+        {
+            if(!VIV_FENCE_BEFORE_EQ(fence, __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE)))
+                rv = VIV_STATUS_TIMEOUT;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&notifier->mutex);
+    return rv;
+}
+
+int viv_notifier_start(struct viv_conn *conn, int *fd_out)
+{
+    int rv = VIV_STATUS_OK;
+    pthread_condattr_t attr;
+    pthread_mutex_lock(&conn->fence_mutex);
+    if(conn->notifier != NULL)
+        goto unlock_and_return;
+    struct viv_notifier *notifier = ETNA_CALLOC_STRUCT(viv_notifier);
+    if(notifier == NULL)
+    {
+        rv = VIV_STATUS_OUT_OF_MEMORY;
+        goto unlock_and_return;
+    }
+    if((notifier->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+        ETNA_FREE(notifier);
+        rv = VIV_STATUS_OUT_OF_RESOURCES;
+        goto unlock_and_return;
+    }
+    if(pthread_condattr_init(&attr) != 0 ||
+       pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+       pthread_cond_init(&notifier->cond, &attr) != 0 ||
+       pthread_mutex_init(&notifier->mutex, NULL) != 0)
+    {
+        close(notifier->fd);
+        ETNA_FREE(notifier);
+        rv = VIV_STATUS_OUT_OF_RESOURCES;
+        goto unlock_and_return;
+    }
+    pthread_condattr_destroy(&attr);
+    notifier->reported = __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE);
+    conn->notifier = notifier;
+    if(pthread_create(&notifier->thread, NULL, viv_notifier_thread, conn) != 0)
+    {
+        conn->notifier = NULL;
+        pthread_mutex_destroy(&notifier->mutex);
+        pthread_cond_destroy(&notifier->cond);
+        close(notifier->fd);
+        ETNA_FREE(notifier);
+        rv = VIV_STATUS_OUT_OF_RESOURCES;
+        goto unlock_and_return;
+    }
+unlock_and_return:
+    if(rv == VIV_STATUS_OK && fd_out != NULL)
+        *fd_out = conn->notifier->fd;
+    pthread_mutex_unlock(&conn->fence_mutex);
+    return rv;
+}
+
+int viv_notifier_stop(struct viv_conn *conn)
+{
+    struct viv_notifier *notifier = conn->notifier;
+    int rv;
+    if(notifier == NULL)
+        return VIV_STATUS_OK;
+    pthread_mutex_lock(&notifier->mutex);
+    notifier->quit = true;
+    pthread_cond_broadcast(&notifier->cond);
+    pthread_mutex_unlock(&notifier->mutex);
+    pthread_join(notifier->thread, NULL);
+
+    pthread_mutex_lock(&conn->fence_mutex);
+    conn->notifier = NULL;
+    pthread_mutex_unlock(&conn->fence_mutex);
+    rv = notifier->error;
+    pthread_mutex_destroy(&notifier->mutex);
+    pthread_cond_destroy(&notifier->cond);
+    close(notifier->fd);
+    ETNA_FREE(notifier);
+    return rv;
+}
+
+uint32_t viv_fence_last_retired(struct viv_conn *conn)
+{
+    return __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE);
+}
+
 /* Fence emulation */
 int _viv_fence_new(struct viv_conn *conn, uint32_t *fence_out, int *signal_out)
 {
     /* Request fence and queue signal */
-    uint32_t fence = conn->next_fence_id++;
-    int signal = signal_for_fence(conn, fence);
+    uint32_t fence = conn->next_fence_id;
+    struct viv_fence_slot *slot = &conn->fences->slots[fence & (conn->fences->num - 1)];
     int status;
-    /*   First, wait for old signal before reusing it if needed */
-    uint32_t oldfence = fence - VIV_NUM_FENCE_SIGNALS;
-    uint32_t fence_mod_signals = (fence % VIV_NUM_FENCE_SIGNALS);
-    if(conn->fences_pending & (1<<fence_mod_signals)) /* fence still pending? */
+    /*   First, make sure the old fence using the slot is done before reusing it.
+     * Polling resets its signal; if a waiter without the mutex got to the
+     * signal first, it has moved last_fence_id past the old fence.
+     */
+    if(slot->state == VIV_FENCE_PENDING)
     {
+        uint32_t oldfence = slot->fence;
+        if(viv_user_signal_wait(conn, slot->signal, 0) != VIV_STATUS_OK &&
+           !VIV_FENCE_BEFORE_EQ(oldfence, __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE)))
+        {
+            /* Still in flight: make room for more fences, and only wait for
+             * it if the table is at its maximum size */
+            if(viv_grow_fences(conn) == VIV_STATUS_OK)
+            {
+                slot = &conn->fences->slots[fence & (conn->fences->num - 1)];
+            } else {
 #ifdef FENCE_DEBUG
-        fprintf(stderr, "Waiting for old fence %08x (which is after %08x)\n", oldfence,
-                conn->last_fence_id);
+                fprintf(stderr, "Waiting for old fence %08x (which is after %08x)\n", oldfence,
+                        conn->last_fence_id);
 #endif
-        if((status = viv_user_signal_wait(conn, signal, VIV_WAIT_INDEFINITE)) != VIV_STATUS_OK)
-        {
-            return status;
+                conn->fence_alloc_stalls += 1;
+                /* wait in slices, as a waiter without the mutex can take the signal */
+                while((status = viv_user_signal_wait(conn, slot->signal, VIV_FENCE_STALL_SLICE_MS)) != VIV_STATUS_OK)
+                {
+                    if(status != VIV_STATUS_TIMEOUT)
+                        return status;
+                    if(VIV_FENCE_BEFORE_EQ(oldfence, __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE)))
+                        break;
+                }
+            }
         }
-        /* update last signalled fence if necessary */
-        if(VIV_FENCE_BEFORE(conn->last_fence_id, oldfence))
-            conn->last_fence_id = oldfence;
-        conn->fences_pending &= ~(1<<fence_mod_signals);
+        /* update last signalled fence if necessary (the slot of a grown
+         * table is a new one, so nothing was signalled) */
+        if(slot->state == VIV_FENCE_PENDING)
+            viv_fence_retire(conn, oldfence);
     }
+    __atomic_store_n(&slot->state, VIV_FENCE_DEALT, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->fence, fence, __ATOMIC_RELEASE);
+    __atomic_store_n(&conn->next_fence_id, fence + 1, __ATOMIC_RELEASE);
     *fence_out = fence;
-    *signal_out = signal;
+    *signal_out = slot->signal;
 #ifdef FENCE_DEBUG
-    fprintf(stderr, "New fence: %08x [signal %08x], pending %08x\n", fence, signal, conn->fences_pending);
+    fprintf(stderr, "New fence: %08x [signal %08x], %u fence slots\n", fence, slot->signal, conn->fences->num);
 #endif
     return VIV_STATUS_OK;
 }
 
 void _viv_fence_mark_pending(struct viv_conn *conn, uint32_t fence)
 {
-    if((conn->next_fence_id - fence) >= VIV_NUM_FENCE_SIGNALS)
+    struct viv_fence_slot *slot = &conn->fences->slots[fence & (conn->fences->num - 1)];
+    if(slot->fence != fence)
         return; /* too old */
-    conn->fences_pending |= (1<<(fence % VIV_NUM_FENCE_SIGNALS));
+    __atomic_store_n(&slot->state, VIV_FENCE_PENDING, __ATOMIC_RELEASE);
+    if(conn->notifier != NULL)
+        viv_notifier_kick(conn->notifier);
 }
 
 int viv_fence_finish(struct viv_conn *conn, uint32_t fence, uint32_t timeout)
 {
-    int signal;
+    int signal = -1;
     int rv;
-    pthread_mutex_lock(&conn->fence_mutex);
-    signal = signal_for_fence(conn, fence);
-    if(signal == -1)
-    {
-#ifdef FENCE_DEBUG
-        fprintf(stderr, "Fence already expired: %08x\n", fence);
-#endif
-        goto unlock_and_ok; /* fence too old, it must have been signalled already */
-    }
     /* If fence is older than last_fence_id which is the last signalled fence,
      * it must already have been signalled. We can make use of the fact that there is only
      * one ringbuffer inside the kernel, so commands submitted prior to this
      * fence will be executed before this fence.
      * Also check whether fence is really pending, if not simply return.
      */
-    uint32_t fence_mod_signals = (fence % VIV_NUM_FENCE_SIGNALS);
-    if(!(conn->fences_pending & (1<<fence_mod_signals)) ||
-        VIV_FENCE_BEFORE_EQ(fence, conn->last_fence_id))
+    uint32_t state = viv_fence_peek(conn, fence, &signal);
+    if(state == VIV_FENCE_DEALT)
+    {
+        /* The signal is being queued, which happens with the mutex held.
+         * If it still isn't pending after that, the commit failed. */
+        pthread_mutex_lock(&conn->fence_mutex);
+        state = viv_fence_peek(conn, fence, &signal);
+        pthread_mutex_unlock(&conn->fence_mutex);
+    }
+    if(state != VIV_FENCE_PENDING)
     {
 #ifdef FENCE_DEBUG
-        fprintf(stderr, "Fence already signaled: %08x, pending %i, newer than %08x; next fence id is %08x\n",
-                fence,
-                (conn->fences_pending >> fence_mod_signals)&1,
-                conn->last_fence_id, conn->next_fence_id);
+        fprintf(stderr, "Fence already signaled: %08x, state %i, last fence %08x; next fence id is %08x\n",
+                fence, state, conn->last_fence_id, conn->next_fence_id);
 #endif
-        goto unlock_and_ok;
+        return VIV_STATUS_OK;
     }
-    pthread_mutex_unlock(&conn->fence_mutex); /* don't keep mutex while waiting */
+    if(timeout != 0 && conn->notifier != NULL)
+        return viv_notifier_wait(conn, fence, timeout); /* the notifier takes the signals */
 
-    rv = viv_user_signal_wait(conn, signal, timeout);
-    if(rv == VIV_STATUS_OK)
+    /* Wait in slices: the signal resets when taken, and another waiter or a
+     * poll may take it first, retiring the fence instead of us */
+    uint32_t waited = 0;
+    while(true)
     {
-        pthread_mutex_lock(&conn->fence_mutex);
-        /* mark fence as non-pending */
-        conn->fences_pending &= ~(1<<fence_mod_signals);
-        /* if fence is later than last_fence_id, update last_fence_id */
-        if(VIV_FENCE_BEFORE(conn->last_fence_id, fence))
+        uint32_t slice = VIV_FENCE_STALL_SLICE_MS;
+        if(timeout != VIV_WAIT_INDEFINITE && (timeout - waited) < slice)
+            slice = timeout - waited;
+        rv = viv_user_signal_wait(conn, signal, slice);
+        if(rv == VIV_STATUS_OK)
         {
-            conn->last_fence_id = fence;
-#ifdef FENCE_DEBUG
-            fprintf(stderr, "Last fence id updated to %i\n", conn->last_fence_id);
-#endif
+            viv_fence_retire(conn, fence);
+            return VIV_STATUS_OK;
         }
-        pthread_mutex_unlock(&conn->fence_mutex);
+        if(VIV_FENCE_BEFORE_EQ(fence, __atomic_load_n(&conn->last_fence_id, __ATOMIC_ACQUIRE)))
+            return VIV_STATUS_OK; /* another waiter took the signal */
+        if(rv != VIV_STATUS_TIMEOUT)
+            return rv;
+        if(timeout != VIV_WAIT_INDEFINITE && (waited += slice) >= timeout)
+            return rv;
     }
-    return rv;
+}
 
-unlock_and_ok: /* unlock mutex and return OK */
-    pthread_mutex_unlock(&conn->fence_mutex);
+int viv_fence_wait_many(struct viv_conn *conn, const uint32_t *fences, unsigned n, bool wait_all,
+        uint32_t timeout, unsigned *first_signaled_out)
+{
+    unsigned oldest = 0, newest = 0;
+    int rv;
+    if(fences == NULL || n == 0)
+        return VIV_STATUS_INVALID_ARGUMENT;
+    for(unsigned x=1; x<n; ++x)
+    {
+        if(VIV_FENCE_BEFORE(fences[x], fences[oldest]))
+            oldest = x;
+        if(VIV_FENCE_BEFORE(fences[newest], fences[x]))
+            newest = x;
+    }
+    /* the oldest fence is the first to finish, and the newest the last */
+    if((rv = viv_fence_finish(conn, fences[wait_all ? newest : oldest], timeout)) != VIV_STATUS_OK)
+        return rv;
+    if(first_signaled_out)
+        *first_signaled_out = oldest;
     return VIV_STATUS_OK;
 }
 
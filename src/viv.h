@@ -31,8 +31,13 @@
 
 #define VIV_WAIT_INDEFINITE (0xffffffff)
 
-/* Number of signals to keep for fences, max is 32 */
+/* Number of entries in the asynchronous submission ring (power of two) */
+#define VIV_ASYNC_RING_SIZE 8
+
+/* Number of signals to keep for fences initially, and maximum number the
+ * fence table can grow to (powers of two) */
 #define VIV_NUM_FENCE_SIGNALS 32
+#define VIV_MAX_FENCE_SIGNALS 4096
 
 /* Return true if fence a was before b */
 #define VIV_FENCE_BEFORE(a,b) ((int32_t)((b)-(a))>0)
@@ -182,6 +187,30 @@ struct viv_kernel_driver_version {
     int major, minor, patch, build;
 };
 
+/* State of the fence in a fence table slot */
+enum viv_fence_state {
+    VIV_FENCE_RETIRED = 0, /* signal waited for (or never queued) */
+    VIV_FENCE_DEALT = 1,   /* handed out, signal not queued yet */
+    VIV_FENCE_PENDING = 2  /* signal queued but not yet waited for */
+};
+
+/* Entry in the fence table. fence and state are written with fence_mutex
+ * held, and can be read atomically without it. */
+struct viv_fence_slot {
+    uint32_t fence; /* fence that last used this slot */
+    uint32_t state; /* enum viv_fence_state */
+    int signal; /* user signal of the slot */
+};
+
+/* Fence table, indexed by fence id modulo num. When the table grows, the
+ * previous one is kept (until viv_close) for readers that don't hold
+ * fence_mutex. */
+struct viv_fence_table {
+    struct viv_fence_table *prev;
+    uint32_t num;
+    struct viv_fence_slot slots[];
+};
+
 /* Structure encompassing a connection to kernel driver */
 struct viv_conn {
     int fd;
@@ -194,16 +223,34 @@ struct viv_conn {
     viv_handle_t process;
     struct viv_specs chip;
     struct viv_kernel_driver_version kernel_driver;
-    /* signals for fences */
-    int fence_signals[VIV_NUM_FENCE_SIGNALS];
+    /* fence table */
+    struct viv_fence_table *fences;
     /* guard these with a mutex, so
      * that no races happen and command buffers are submitted
-     * in the same order as the fence ids.
+     * in the same order as the fence ids, also between contexts.
+     * The mutex also serializes producers of the submission ring.
      */
     pthread_mutex_t fence_mutex;
+    /* fences, next_fence_id and last_fence_id can be read atomically without
+     * the mutex; last_fence_id only ever moves forward, and can be advanced
+     * without the mutex as well.
+     */
     uint32_t next_fence_id; /* Next fence number to be dealt */
-    uint32_t fences_pending; /* Bitmask of fences signalled but not yet waited for */
     uint32_t last_fence_id; /* Most recent signalled fence */
+    /* Number of times a new fence had to wait for an old one, because the
+     * fence table could not grow any further */
+    uint32_t fence_alloc_stalls;
+    /* asynchronous submission thread, NULL if not started (set under
+     * fence_mutex; load with acquire when not holding it) */
+    struct viv_async *async;
+    /* fence completion notifier thread, NULL if not started */
+    struct viv_notifier *notifier;
+    /* command stream capture, NULL if not capturing (set under
+     * capture_mutex; load with acquire when not holding it) */
+    struct viv_capture *capture;
+    /* serializes capture writers, and keeps capture from being freed while
+     * a commit is being written */
+    pthread_mutex_t capture_mutex;
 };
 
 /* Predefines for some kernel structures */
@@ -286,6 +333,37 @@ int viv_unmap_user_memory(struct viv_conn *conn, void *memory, size_t size, viv_
  */
 int viv_event_commit(struct viv_conn *conn, struct _gcsQUEUE *queue);
 
+/** Start asynchronous submission thread for this connection.
+ * After this, viv_commit_async can be used to hand off commits to it.
+ * @note Not supported on kernels with a user-space context buffer (v2).
+ */
+int viv_async_start(struct viv_conn *conn);
+
+/** Wait for all asynchronous commits to be submitted, then stop the
+ * submission thread. Called automatically by viv_close.
+ * @returns status of first failed asynchronous commit not reported yet, if any
+ */
+int viv_async_stop(struct viv_conn *conn);
+
+/** Queue a commit of command buffer (may be NULL for only an event queue)
+ * and event queue to the submission thread, and return immediately.
+ * The command buffer structure and queue are copied, so they can be re-used
+ * right away. Commits are submitted in the order they are queued.
+ * Only blocks if VIV_ASYNC_RING_SIZE commits are already waiting.
+ * @note must be called with fence_mutex held; this makes the calling thread
+ * the single producer of the submission ring.
+ * When an asynchronous commit fails, the signals in its queue are set so
+ * that its fences retire, and the error is reported once, by the next
+ * viv_commit_async (which then queues nothing) or viv_async_drain.
+ */
+int viv_commit_async(struct viv_conn *conn, struct _gcoCMDBUF *commandBuffer, viv_context_t context, struct _gcsQUEUE *queue);
+
+/** Wait until all asynchronous commits queued so far have been submitted
+ * to the kernel.
+ * @returns status of first failed asynchronous commit not reported yet, if any
+ */
+int viv_async_drain(struct viv_conn *conn);
+
 /** Create a new user signal.
  *  if manualReset=0 automatic reset on completion of signal_wait
  *     manualReset=1 need to manually reset state to 0 using SIGNAL
@@ -336,15 +414,61 @@ int _viv_fence_new(struct viv_conn *conn, uint32_t *fence_out, int *signal_out);
  */
 void _viv_fence_mark_pending(struct viv_conn *conn, uint32_t fence);
 
+/** Internal: Wait until all asynchronous commits queued so far have been
+ * submitted, like viv_async_drain, but leave any error to be reported to
+ * the submitting context.
+ */
+void _viv_async_wait(struct viv_conn *conn);
+
 /** Wait for fence or poll status.
  * Timeout is in milliseconds.
  * Pass a timeout of 0 to poll fence status, or VIV_WAIT_INDEFINITE to wait forever.
+ * Polling, and waiting for a fence known to be signalled already, don't
+ * take fence_mutex.
  * @return VIV_STATUS_OK if fence finished
  *         VIV_STATUS_TIMEOUT if timeout expired first
  *         other if an error occured
  */
 int viv_fence_finish(struct viv_conn *conn, uint32_t fence, uint32_t timeout);
 
+/** Wait for all (wait_all) or any of n fences, or poll their status.
+ * Fences finish in the order they were handed out, so this blocks on a single
+ * signal: the newest fence for wait_all, the oldest one otherwise.
+ * If first_signaled_out is not NULL, the index in fences of the oldest fence,
+ * which is the first to finish, is returned in it.
+ * Timeout is as for viv_fence_finish.
+ * @return VIV_STATUS_OK if the fences finished
+ *         VIV_STATUS_TIMEOUT if timeout expired first
+ *         VIV_STATUS_INVALID_ARGUMENT if n is 0
+ *         other if an error occured
+ */
+int viv_fence_wait_many(struct viv_conn *conn, const uint32_t *fences, unsigned n, bool wait_all,
+        uint32_t timeout, unsigned *first_signaled_out);
+
+/** Start the fence completion notifier thread for this connection, which
+ * waits for pending fences in order, and makes the eventfd returned in
+ * fd_out readable whenever fences retire. Read the eventfd to clear it, then
+ * use viv_fence_last_retired to see how far the GPU got. This allows waiting
+ * for fences in a poll/epoll loop.
+ * While the notifier runs, blocking waits in viv_fence_finish wait for it,
+ * instead of for the kernel signal.
+ * If the notifier is running already, its eventfd is returned.
+ * @note the eventfd is owned by the connection, don't close it.
+ */
+int viv_notifier_start(struct viv_conn *conn, int *fd_out);
+
+/** Stop the fence completion notifier thread, and close its eventfd.
+ * Called automatically by viv_close. No other thread may be waiting for a
+ * fence at this time.
+ * @returns error that stopped the thread early, if any
+ */
+int viv_notifier_stop(struct viv_conn *conn);
+
+/** Return the most recent fence known to be retired. All fences dealt
+ * before it are retired as well (see VIV_FENCE_BEFORE_EQ).
+ */
+uint32_t viv_fence_last_retired(struct viv_conn *conn);
+
 /** Convenience macro to probe features from state.xml.h:
  * VIV_FEATURE(chipFeatures, FAST_CLEAR)
  * VIV_FEATURE(chipMinorFeatures1, AUTO_DISABLE)
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include <viv_capture.h>
+#include <viv.h>
+#include <etna_util.h>
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gc_abi.h"
+#include "viv_internal.h"
+
+//#define DEBUG
+
+/* Initial size of capture file mapping, doubled whenever it runs out */
+#define VIV_CAPTURE_INITIAL_SIZE (1024*1024)
+
+/* Records are padded to this alignment */
+#define VIV_CAPTURE_ALIGN(x) (((x) + 7) & ~7)
+
+/* Writers can come from several threads, and are serialized by the
+ * connection's capture_mutex */
+struct viv_capture {
+    int fd;
+    uint8_t *map; /* mapping of whole file */
+    size_t map_size; /* current size of file and mapping */
+    size_t pos; /* end of data written so far */
+    bool failed; /* stop writing after an I/O error */
+};
+
+/* Make sure that at least size bytes are available at the write position.
+ * Grows the file and re-maps it when needed.
+ */
+static bool capture_ensure(struct viv_capture *cap, size_t size)
+{
+    if(cap->failed)
+        return false;
+    if(cap->pos + size <= cap->map_size)
+        return true;
+    size_t new_size = cap->map_size * 2;
+    while(new_size < cap->pos + size)
+        new_size *= 2;
+    munmap(cap->map, cap->map_size);
+    cap->map = NULL;
+    if(ftruncate(cap->fd, new_size) < 0 ||
+       (cap->map = mmap(NULL, new_size, PROT_READ|PROT_WRITE, MAP_SHARED, cap->fd, 0)) == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: could not grow capture file, capture stopped\n", __func__);
+        cap->map = NULL;
+        cap->map_size = 0;
+        cap->failed = true;
+        return false;
+    }
+    cap->map_size = new_size;
+    return true;
+}
+
+/* Append a record consisting of a fixed-size descriptor and variable-size data.
+ * Must be called with conn->capture_mutex held.
+ */
+static void capture_write(struct viv_capture *cap, uint32_t type, const void *desc, size_t desc_size, const void *data, size_t data_size)
+{
+    size_t payload = desc_size + data_size;
+    size_t total = sizeof(struct viv_capture_record) + VIV_CAPTURE_ALIGN(payload);
+    if(!capture_ensure(cap, total))
+        return;
+    struct viv_capture_record *rec = (struct viv_capture_record*)&cap->map[cap->pos];
+    rec->type = type;
+    rec->size = payload;
+    rec->timestamp = etna_time_ns();
+    uint8_t *ptr = (uint8_t*)(rec + 1);
+    memcpy(ptr, desc, desc_size);
+    if(data_size)
+        memcpy(ptr + desc_size, data, data_size);
+    memset(ptr + payload, 0, VIV_CAPTURE_ALIGN(payload) - payload);
+    cap->pos += total;
+}
+
+int viv_capture_start(struct viv_conn *conn, const char *path)
+{
+    if(conn == NULL || path == NULL)
+        return VIV_STATUS_INVALID_ARGUMENT;
+    pthread_mutex_lock(&conn->capture_mutex);
+    if(conn->capture != NULL)
+    {
+        pthread_mutex_unlock(&conn->capture_mutex);
+        return VIV_STATUS_INVALID_REQUEST;
+    }
+    struct viv_capture *cap = ETNA_CALLOC_STRUCT(viv_capture);
+    if(cap == NULL)
+    {
+        pthread_mutex_unlock(&conn->capture_mutex);
+        return VIV_STATUS_OUT_OF_MEMORY;
+    }
+    cap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(cap->fd < 0)
+        goto error;
+    cap->map_size = VIV_CAPTURE_INITIAL_SIZE;
+    if(ftruncate(cap->fd, cap->map_size) < 0)
+        goto error;
+    cap->map = mmap(NULL, cap->map_size, PROT_READ|PROT_WRITE, MAP_SHARED, cap->fd, 0);
+    if(cap->map == MAP_FAILED)
+        goto error;
+
+    struct viv_capture_header *hdr = (struct viv_capture_header*)cap->map;
+    memcpy(hdr->magic, VIV_CAPTURE_MAGIC, sizeof(hdr->magic));
+    hdr->version = VIV_CAPTURE_VERSION;
+    hdr->flags = 0;
+#ifdef GCABI_HAS_CONTEXT
+    hdr->flags |= VIV_CAPTURE_FLAG_HAS_CONTEXT;
+#endif
+    cap->pos = sizeof(struct viv_capture_header);
+#ifdef DEBUG
+    fprintf(stderr, "%s: capturing to %s\n", __func__, path);
+#endif
+    __atomic_store_n(&conn->capture, cap, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&conn->capture_mutex);
+    return VIV_STATUS_OK;
+error:
+    pthread_mutex_unlock(&conn->capture_mutex);
+    fprintf(stderr, "%s: could not create capture file %s\n", __func__, path);
+    if(cap->fd >= 0)
+        close(cap->fd);
+    ETNA_FREE(cap);
+    return VIV_STATUS_GENERIC_IO;
+}
+
+int viv_capture_stop(struct viv_conn *conn)
+{
+    if(conn == NULL)
+        return VIV_STATUS_INVALID_ARGUMENT;
+    int rv = VIV_STATUS_OK;
+    /* once unpublished under the mutex, no writer can still be using it */
+    pthread_mutex_lock(&conn->capture_mutex);
+    struct viv_capture *cap = conn->capture;
+    __atomic_store_n(&conn->capture, NULL, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&conn->capture_mutex);
+    if(cap == NULL)
+        return VIV_STATUS_OK;
+    if(cap->map != NULL)
+        munmap(cap->map, cap->map_size);
+    /* cut off unused part of last growth step */
+    if(ftruncate(cap->fd, cap->pos) < 0 || cap->failed)
+        rv = VIV_STATUS_GENERIC_IO;
+    close(cap->fd);
+    ETNA_FREE(cap);
+    return rv;
+}
+
+void _viv_capture_commit(struct viv_conn *conn, struct _gcoCMDBUF *commandBuffer, void *contextBuffer)
+{
+    if(__atomic_load_n(&conn->capture, __ATOMIC_ACQUIRE) == NULL)
+        return; /* not capturing, don't take the mutex */
+    pthread_mutex_lock(&conn->capture_mutex);
+    struct viv_capture *cap = conn->capture; /* may have been stopped meanwhile */
+    if(cap == NULL)
+    {
+        pthread_mutex_unlock(&conn->capture_mutex);
+        return;
+    }
+#ifdef GCABI_HAS_CONTEXT
+    gcoCONTEXT vctx = contextBuffer;
+    if(vctx != NULL && vctx->logical != NULL)
+    {
+        struct viv_capture_context desc = {
+#ifdef GCABI_CONTEXT_HAS_PHYSICAL
+            .address = (uint32_t)(uintptr_t)VIV_TO_PTR(vctx->physical),
+#else
+            .address = 0, /* not known to user space */
+#endif
+            .count = vctx->bufferSize / 4,
+            .entry_pipe = vctx->entryPipe,
+            .current_pipe = vctx->currentPipe
+        };
+        capture_write(cap, VIV_CAPTURE_CONTEXT, &desc, sizeof(desc), vctx->logical, desc.count * 4);
+    }
+#endif
+    if(commandBuffer != NULL)
+    {
+        const uint8_t *logical = VIV_TO_PTR(commandBuffer->logical);
+        struct viv_capture_commit desc = {
+#ifdef GCABI_CMDBUF_HAS_PHYSICAL
+            .address = (uint32_t)(uintptr_t)VIV_TO_PTR(commandBuffer->physical) + commandBuffer->startOffset,
+#else
+            .address = 0, /* not known to user space */
+#endif
+            .start_offset = commandBuffer->startOffset,
+            .count = (commandBuffer->offset - commandBuffer->startOffset) / 4
+        };
+        capture_write(cap, VIV_CAPTURE_COMMIT, &desc, sizeof(desc), &logical[commandBuffer->startOffset], desc.count * 4);
+    }
+    pthread_mutex_unlock(&conn->capture_mutex);
+}
+
+void _viv_capture_events(struct viv_conn *conn, struct _gcsQUEUE *queue)
+{
+    if(queue == NULL || __atomic_load_n(&conn->capture, __ATOMIC_ACQUIRE) == NULL)
+        return;
+    struct viv_capture_event desc = {
+        .count = 0,
+        .entry_size = sizeof(gcsHAL_INTERFACE)
+    };
+    for(struct _gcsQUEUE *q = queue; q != NULL; q = VIV_TO_PTR(q->next))
+        desc.count += 1;
+    pthread_mutex_lock(&conn->capture_mutex);
+    struct viv_capture *cap = conn->capture; /* may have been stopped meanwhile */
+    size_t payload = sizeof(desc) + desc.count * desc.entry_size;
+    if(cap != NULL && capture_ensure(cap, sizeof(struct viv_capture_record) + VIV_CAPTURE_ALIGN(payload)))
+    {
+        /* entries are not contiguous in general, write record in place */
+        struct viv_capture_record *rec = (struct viv_capture_record*)&cap->map[cap->pos];
+        rec->type = VIV_CAPTURE_EVENT;
+        rec->size = payload;
+        rec->timestamp = etna_time_ns();
+        uint8_t *ptr = (uint8_t*)(rec + 1);
+        memcpy(ptr, &desc, sizeof(desc));
+        ptr += sizeof(desc);
+        for(struct _gcsQUEUE *q = queue; q != NULL; q = VIV_TO_PTR(q->next))
+        {
+            memcpy(ptr, &q->iface, desc.entry_size);
+            ptr += desc.entry_size;
+        }
+        memset(ptr, 0, VIV_CAPTURE_ALIGN(payload) - payload);
+        cap->pos += sizeof(struct viv_capture_record) + VIV_CAPTURE_ALIGN(payload);
+    }
+    pthread_mutex_unlock(&conn->capture_mutex);
+}
+
+int viv_replay(const char *path, const struct viv_replay_backend *backend)
+{
+    int rv = VIV_STATUS_OK;
+    struct stat st;
+    if(path == NULL || backend == NULL)
+        return VIV_STATUS_INVALID_ARGUMENT;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return VIV_STATUS_GENERIC_IO;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct viv_capture_header))
+    {
+        close(fd);
+        return VIV_STATUS_INVALID_DATA;
+    }
+    size_t size = st.st_size;
+    const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return VIV_STATUS_GENERIC_IO;
+
+    const struct viv_capture_header *hdr = (const struct viv_capture_header*)map;
+    if(memcmp(hdr->magic, VIV_CAPTURE_MAGIC, sizeof(hdr->magic)) != 0 ||
+       hdr->version != VIV_CAPTURE_VERSION)
+    {
+        rv = VIV_STATUS_VERSION_MISMATCH;
+        goto unmap_and_return;
+    }
+    size_t pos = sizeof(struct viv_capture_header);
+    while(rv == VIV_STATUS_OK && pos + sizeof(struct viv_capture_record) <= size)
+    {
+        const struct viv_capture_record *rec = (const struct viv_capture_record*)&map[pos];
+        const uint8_t *payload = (const uint8_t*)(rec + 1);
+        pos += sizeof(struct viv_capture_record) + VIV_CAPTURE_ALIGN((size_t)rec->size);
+        if(pos > size)
+        {
+            rv = VIV_STATUS_INVALID_DATA; /* truncated capture */
+            break;
+        }
+        switch(rec->type)
+        {
+        case VIV_CAPTURE_COMMIT: {
+            const struct viv_capture_commit *desc = (const struct viv_capture_commit*)payload;
+            if(rec->size < sizeof(*desc) || (rec->size - sizeof(*desc)) / 4 < desc->count)
+                rv = VIV_STATUS_INVALID_DATA;
+            else if(backend->commit)
+                rv = backend->commit(backend->data, rec->timestamp, desc, (const uint32_t*)(desc + 1));
+            } break;
+        case VIV_CAPTURE_CONTEXT: {
+            const struct viv_capture_context *desc = (const struct viv_capture_context*)payload;
+            if(rec->size < sizeof(*desc) || (rec->size - sizeof(*desc)) / 4 < desc->count)
+                rv = VIV_STATUS_INVALID_DATA;
+            else if(backend->context)
+                rv = backend->context(backend->data, rec->timestamp, desc, (const uint32_t*)(desc + 1));
+            } break;
+        case VIV_CAPTURE_EVENT: {
+            const struct viv_capture_event *desc = (const struct viv_capture_event*)payload;
+            if(rec->size < sizeof(*desc) || desc->entry_size == 0 ||
+               (rec->size - sizeof(*desc)) / desc->entry_size < desc->count)
+                rv = VIV_STATUS_INVALID_DATA;
+            else if(backend->event)
+                rv = backend->event(backend->data, rec->timestamp, desc, desc + 1);
+            } break;
+        default: /* skip unknown records, for forward compatibility */
+#ifdef DEBUG
+            fprintf(stderr, "%s: skipping unknown record type %u\n", __func__, rec->type);
+#endif
+            break;
+        }
+    }
+unmap_and_return:
+    munmap((void*)map, size);
+    return rv;
+}
+
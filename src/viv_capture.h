@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2012-2013 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sub license,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+/* Binary capture of everything submitted to the kernel, and replay of
+ * such captures.
+ *
+ * A capture file starts with a struct viv_capture_header, followed by
+ * records. Every record is a struct viv_capture_record followed by its
+ * payload, padded to a multiple of 8 bytes. All fields are in native
+ * byte order.
+ * Only the words of committed buffers themselves are recorded; buffers
+ * reached through LINK or CALL (chained segments, command blocks) are not.
+ */
+#ifndef H_VIV_CAPTURE
+#define H_VIV_CAPTURE
+
+#include <stdint.h>
+
+struct viv_conn;
+struct _gcoCMDBUF;
+struct _gcsQUEUE;
+
+#define VIV_CAPTURE_MAGIC "ETNACAP1"
+#define VIV_CAPTURE_VERSION 1
+
+/* Header flags, describe the kernel interface of the capturing build */
+#define VIV_CAPTURE_FLAG_HAS_CONTEXT (1<<0) /* user-space context buffers (v2) */
+
+enum viv_capture_record_type {
+    VIV_CAPTURE_COMMIT = 1, /* struct viv_capture_commit + command words */
+    VIV_CAPTURE_CONTEXT = 2, /* struct viv_capture_context + context buffer words */
+    VIV_CAPTURE_EVENT = 3, /* struct viv_capture_event + raw kernel interface structures */
+};
+
+struct viv_capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+};
+
+struct viv_capture_record {
+    uint32_t type; /* enum viv_capture_record_type */
+    uint32_t size; /* size of payload in bytes, excluding padding */
+    uint64_t timestamp; /* CLOCK_MONOTONIC, in nanoseconds */
+};
+
+struct viv_capture_commit {
+    uint32_t address; /* GPU address of first word, 0 if unknown */
+    uint32_t start_offset; /* offset of first word in command buffer, in bytes */
+    uint32_t count; /* number of words */
+    uint32_t pad;
+};
+
+struct viv_capture_context {
+    uint32_t address; /* GPU address of first word, 0 if unknown */
+    uint32_t count; /* number of words */
+    uint32_t entry_pipe;
+    uint32_t current_pipe;
+};
+
+struct viv_capture_event {
+    uint32_t count; /* number of queue entries */
+    uint32_t entry_size; /* size of one kernel interface structure of the capturing build */
+};
+
+/* Backend for viv_replay. Every callback may be NULL to skip records of that
+ * type. A callback returning anything but VIV_STATUS_OK stops the replay and
+ * that status is returned from viv_replay.
+ */
+struct viv_replay_backend {
+    int (*commit)(void *data, uint64_t timestamp, const struct viv_capture_commit *commit, const uint32_t *words);
+    int (*context)(void *data, uint64_t timestamp, const struct viv_capture_context *context, const uint32_t *words);
+    int (*event)(void *data, uint64_t timestamp, const struct viv_capture_event *event, const void *entries);
+    void *data;
+};
+
+/** Start capturing all commits and event queues submitted through this
+ * connection to file at path, which is created or truncated.
+ * Capturing is also started by viv_open when the environment variable
+ * ETNAVIV_CAPTURE is set to a file name.
+ */
+int viv_capture_start(struct viv_conn *conn, const char *path);
+
+/** Stop capturing and close the capture file. Called automatically by viv_close.
+ */
+int viv_capture_stop(struct viv_conn *conn);
+
+/** Internal: record a commit of command buffer and (v2) context buffer.
+ * The queue is recorded separately through _viv_capture_events.
+ */
+void _viv_capture_commit(struct viv_conn *conn, struct _gcoCMDBUF *commandBuffer, void *contextBuffer);
+
+/** Internal: record an event queue */
+void _viv_capture_events(struct viv_conn *conn, struct _gcsQUEUE *queue);
+
+/** Walk through a capture file, and call the backend for every record, in order.
+ * @note Command and context words contain GPU addresses that are only valid
+ * in the capturing process. Replaying on hardware requires the referenced
+ * buffers to live at the same addresses; event records contain kernel handles
+ * that are stale outside of the capturing process.
+ */
+int viv_replay(const char *path, const struct viv_replay_backend *backend);
+
+#endif
+